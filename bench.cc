@@ -0,0 +1,371 @@
+/////////////////////////////////////////////////////////////////////////////
+// Microbenchmarks of the splat and tonemap kernels, hue() and aux::versor against plain arrays,
+// without a Wayland connection. Every result is one JSON line; --baseline compares them with
+// the lines of an earlier run and fails on a regression past --tolerance.
+#define OTHONES_NO_MAIN
+#include "othones.cc"
+
+#include <map>
+#include <sstream>
+
+namespace
+{
+    // keeps the compiler from dropping a computation whose result is never read
+    template <class T>
+    void keep(T const& value) noexcept {
+        asm volatile("" : : "g"(&value) : "memory");
+    }
+
+    struct result {
+        std::string name;
+        size_t ops;        // operations per timed call
+        size_t calls;
+        double p50;        // ns per operation
+        double min;
+    };
+
+    class bench {
+    public:
+        bench(double seconds, std::string_view filter, std::string backend)
+            : seconds{seconds}
+            , filter{filter}
+            , backend{std::move(backend)}
+            {
+            }
+
+        // Times f(), `ops` operations per call, until the time budget is spent and at least
+        // MIN_CALLS times; setup() runs before every call, untimed.
+        template <class F, class Setup = decltype (lamed())>
+        void run(std::string name, size_t ops, F&& f, Setup&& setup = lamed()) {
+            static constexpr size_t MIN_CALLS = 5;
+            if (name.find(this->filter) == std::string::npos) {
+                return;
+            }
+            using clock = std::chrono::steady_clock;
+            std::vector<double> ns;
+            auto const until = clock::now() + std::chrono::duration<double>(this->seconds);
+            while (ns.size() < MIN_CALLS || clock::now() < until) {
+                setup();
+                auto t0 = clock::now();
+                f();
+                ns.push_back(std::chrono::duration<double, std::nano>(clock::now() - t0).count() / ops);
+            }
+            std::sort(ns.begin(), ns.end());
+            this->results.push_back({ std::move(name), ops, ns.size(), ns[ns.size() / 2], ns.front() });
+            this->print(std::cerr, this->results.back());
+        }
+
+        void write_json(std::ostream& out) const {
+            out << std::fixed << std::setprecision(3);
+            for (auto const& r : this->results) {
+                out << "{\"name\":\"" << r.name << "\",\"backend\":\"" << this->backend
+                    << "\",\"ops\":" << r.ops << ",\"calls\":" << r.calls
+                    << ",\"ns_per_op_p50\":" << r.p50 << ",\"ns_per_op_min\":" << r.min << '}' << std::endl;
+            }
+        }
+
+        // Compares the p50 of every result with the same name and backend in the baseline's JSON lines
+        // and returns how many got slower by more than `tolerance`, a fraction. Lines of another
+        // backend are skipped, a device is not a regression of another.
+        size_t compare(std::istream& baseline, double tolerance) const {
+            std::map<std::string, double, std::less<>> before;
+            for (std::string line; std::getline(baseline, line); ) {
+                auto field = [&](std::string_view key) {
+                    auto at = line.find(key);
+                    return at == std::string::npos ? std::string{} : line.substr(at + key.size());
+                };
+                auto name = field("\"name\":\"");
+                auto backend = field("\"backend\":\"");
+                auto p50 = field("\"ns_per_op_p50\":");
+                if (backend.substr(0, backend.find('"')) != this->backend) {
+                    continue;
+                }
+                if (name.empty() == false && p50.empty() == false) {
+                    before[name.substr(0, name.find('"'))] = std::strtod(p50.c_str(), nullptr);
+                }
+            }
+            size_t regressions = 0;
+            for (auto const& r : this->results) {
+                auto it = before.find(r.name);
+                if (it == before.end()) {
+                    continue;
+                }
+                auto ratio = r.p50 / it->second;
+                bool const regressed = ratio > 1 + tolerance;
+                regressions += regressed;
+                std::cerr << (regressed ? "REGRESSED " : "          ") << std::left << std::setw(44) << r.name
+                          << std::right << std::setw(12) << it->second << " -> " << std::setw(12) << r.p50
+                          << " ns  x" << std::setprecision(2) << ratio << std::setprecision(3) << std::endl;
+            }
+            return regressions;
+        }
+
+    private:
+        static void print(std::ostream& out, result const& r) {
+            out << std::left << std::setw(44) << r.name << std::right << std::fixed << std::setprecision(3)
+                << std::setw(14) << r.p50 << " ns/op p50" << std::setw(14) << r.min << " min, " << r.calls << " calls" << std::endl;
+        }
+
+        double seconds;
+        std::string_view filter;
+        std::string backend;
+        std::vector<result> results;
+    };
+
+    auto random_vertices(size_t n, size_t cx, size_t cy, uint32_t seed) {
+        std::mt19937 rng{seed};
+        std::uniform_real_distribution<double> x{0, static_cast<double>(cx)};
+        std::uniform_real_distribution<double> y{0, static_cast<double>(cy)};
+        std::vector<weighted_vertex> vertices(n);
+        for (auto& v : vertices) {
+            v.position = { x(rng), y(rng) };
+        }
+        return vertices;
+    }
+
+    void splat_benchmarks(bench& b, aux::device& dev, bool quick) {
+        static constexpr size_t cx = 1920;
+        static constexpr size_t cy = 1080;
+        auto canvas = ::canvas<packed_rgb>{dev, cx, cy};
+        auto sp = spiral{dev};
+        for (size_t n : quick ? std::vector<size_t>{ 1024 } : std::vector<size_t>{ 256, 4096, 16384 }) {
+            auto vertices = random_vertices(n, cx, cy, n);
+            for (uint32_t N : quick ? std::vector<uint32_t>{ 89, 233 } : std::vector<uint32_t>{ 89, 233, 610 }) {
+                for (double D : quick ? std::vector<double>{ 2 } : std::vector<double>{ 1, 2, 4 }) {
+                    sp.assign(N, D);
+                    std::ostringstream name;
+                    name << "splat/vertices=" << n << "/N=" << N << "/D=" << D;
+                    b.run(name.str(), 1, [&] {
+                        canvas.splat(sp, vertices);
+                        dev.wait();
+                    }, [&] {
+                        canvas.clear(); // counts past SATURATION would take a shortcut
+                        dev.wait();
+                    });
+                }
+            }
+        }
+    }
+
+    void tonemap_benchmarks(bench& b, aux::device& dev, bool quick) {
+        using resolution = std::pair<size_t, size_t>;
+        for (auto [cx, cy] : quick ? std::vector<resolution>{ { 1280, 720 } }
+                                   : std::vector<resolution>{ { 1280, 720 }, { 1920, 1080 }, { 2560, 1440 }, { 3840, 2160 } }) {
+            auto canvas = ::canvas<packed_rgb>{dev, cx, cy};
+            auto sp = spiral{dev};
+            sp.assign(233, 2);
+            canvas.clear();
+            canvas.splat(sp, random_vertices(4096, cx, cy, 1));
+            std::vector<uint32_t> pixels(cx*cy);
+            std::ostringstream name;
+            name << "tonemap/" << cx << 'x' << cy << '/' << xrgb8888::name;
+            b.run(name.str(), 1, [&] {
+                canvas.tonemap<xrgb8888>({ 0, 0, static_cast<int32_t>(cx), static_cast<int32_t>(cy) }, pixels.data());
+            });
+        }
+    }
+
+    void hue_benchmarks(bench& b) {
+        static constexpr uint32_t H = 1531;
+        b.run("hue", H, [] {
+            uint32_t sum = 0;
+            for (uint32_t h = 0; h < H; ++h) {
+                auto c = hue(h);
+                sum += c[0] + c[1] + c[2];
+            }
+            keep(sum);
+        });
+    }
+
+    // The same loops over versors and over std::arrays of their elements.
+    void versor_benchmarks(bench& b) {
+        static constexpr size_t n = 4096;
+        using plain = std::array<double, 3>;
+        std::vector<aux::vec3d> va(n), vb(n), vc(n);
+        std::vector<plain> pa(n), pb(n), pc(n);
+        std::mt19937 rng{7};
+        std::uniform_real_distribution<double> u{-1, 1};
+        for (size_t i = 0; i < n; ++i) {
+            va[i] = { u(rng), u(rng), u(rng) };
+            vb[i] = { u(rng), u(rng), u(rng) };
+            vc[i] = { u(rng), u(rng), u(rng) };
+            pa[i] = { va[i][0], va[i][1], va[i][2] };
+            pb[i] = { vb[i][0], vb[i][1], vb[i][2] };
+            pc[i] = { vc[i][0], vc[i][1], vc[i][2] };
+        }
+        auto dot = [](plain const& a, plain const& b) noexcept {
+            return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+        };
+        auto cross = [](plain const& a, plain const& b) noexcept {
+            return plain{ a[1]*b[2] - a[2]*b[1], a[2]*b[0] - a[0]*b[2], a[0]*b[1] - a[1]*b[0] };
+        };
+
+        b.run("versor/apply/vec3d", n, [&] {
+            for (size_t i = 0; i < n; ++i) {
+                va[i].apply(std::plus<double>(), vb[i]);
+            }
+            keep(va);
+        });
+        b.run("array/apply/vec3d", n, [&] {
+            for (size_t i = 0; i < n; ++i) {
+                for (size_t k = 0; k < 3; ++k) {
+                    pa[i][k] += pb[i][k];
+                }
+            }
+            keep(pa);
+        });
+        b.run("versor/inner/vec3d", n, [&] {
+            double sum = 0;
+            for (size_t i = 0; i < n; ++i) {
+                sum += inner(va[i], vb[i]);
+            }
+            keep(sum);
+        });
+        b.run("array/inner/vec3d", n, [&] {
+            double sum = 0;
+            for (size_t i = 0; i < n; ++i) {
+                sum += dot(pa[i], pb[i]);
+            }
+            keep(sum);
+        });
+        b.run("versor/cross/vec3d", n, [&] {
+            for (size_t i = 0; i < n; ++i) {
+                vc[i] = aux::cross(va[i], vb[i]);
+            }
+            keep(vc);
+        });
+        b.run("array/cross/vec3d", n, [&] {
+            for (size_t i = 0; i < n; ++i) {
+                pc[i] = cross(pa[i], pb[i]);
+            }
+            keep(pc);
+        });
+        b.run("versor/det/vec3d", n, [&] {
+            double sum = 0;
+            for (size_t i = 0; i < n; ++i) {
+                sum += aux::det(va[i], vb[i], vc[i]);
+            }
+            keep(sum);
+        });
+        b.run("array/det/vec3d", n, [&] {
+            double sum = 0;
+            for (size_t i = 0; i < n; ++i) {
+                sum += dot(cross(pa[i], pb[i]), pc[i]);
+            }
+            keep(sum);
+        });
+
+        // vec4f goes through its vector type (see aux::simd), the array loop through the optimizer
+        using plain4 = std::array<float, 4>;
+        std::vector<aux::vec4f> fa(n), fb(n);
+        std::vector<plain4> qa(n), qb(n);
+        for (size_t i = 0; i < n; ++i) {
+            fa[i] = { u(rng), u(rng), u(rng), u(rng) };
+            fb[i] = { u(rng), u(rng), u(rng), u(rng) };
+            qa[i] = { fa[i][0], fa[i][1], fa[i][2], fa[i][3] };
+            qb[i] = { fb[i][0], fb[i][1], fb[i][2], fb[i][3] };
+        }
+        b.run("versor/axpy/vec4f", n, [&] {
+            for (size_t i = 0; i < n; ++i) {
+                fa[i] += fb[i] * 0.5f;
+            }
+            keep(fa);
+        });
+        b.run("array/axpy/vec4f", n, [&] {
+            for (size_t i = 0; i < n; ++i) {
+                for (size_t k = 0; k < 4; ++k) {
+                    qa[i][k] += qb[i][k] * 0.5f;
+                }
+            }
+            keep(qa);
+        });
+        b.run("versor/inner/vec4f", n, [&] {
+            float sum = 0;
+            for (size_t i = 0; i < n; ++i) {
+                sum += inner(fa[i], fb[i]);
+            }
+            keep(sum);
+        });
+        b.run("array/inner/vec4f", n, [&] {
+            float sum = 0;
+            for (size_t i = 0; i < n; ++i) {
+                sum += qa[i][0]*qb[i][0] + qa[i][1]*qb[i][1] + qa[i][2]*qb[i][2] + qa[i][3]*qb[i][3];
+            }
+            keep(sum);
+        });
+
+        // a bulk translate and scale of vec2d points, stored as versors and as a versor_array
+        std::vector<aux::vec2d> aos(n);
+        for (auto& p : aos) {
+            p = { u(rng), u(rng) };
+        }
+        aux::versor_array<double, 2> soa;
+        soa.assign(aos);
+        b.run("versor/transform/vec2d", n, [&] {
+            for (auto& p : aos) {
+                p = (p + aux::vec2d{0.5, -0.5}) * 0.75;
+            }
+            keep(aos);
+        });
+        b.run("versor_array/transform/vec2d", n, [&] {
+            soa.apply([](double x, double t) noexcept { return (x + t) * 0.75; }, aux::vec2d{0.5, -0.5});
+            keep(soa);
+        });
+    }
+}
+
+int main(int argc, char** argv) {
+    std::string_view backend = "native";
+    std::string_view filter;
+    std::string_view output;   // JSON lines, stdout when empty
+    std::string_view baseline; // JSON lines of an earlier run to compare with
+    double tolerance = 0.10;
+    double seconds = 0.5;      // per benchmark
+    bool quick = false;        // few cases and a short budget, a smoke test for CTest
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        auto value = [&] {
+            if (i+1 < argc) {
+                return argv[++i];
+            }
+            throw std::runtime_error("missing option value...");
+        };
+        if      (arg == "--backend")   backend = value();
+        else if (arg == "--filter")    filter = value();
+        else if (arg == "--output")    output = value();
+        else if (arg == "--baseline")  baseline = value();
+        else if (arg == "--tolerance") tolerance = std::strtod(value(), nullptr);
+        else if (arg == "--seconds")   seconds = std::strtod(value(), nullptr);
+        else if (arg == "--quick")     quick = true;
+        else {
+            throw std::runtime_error("unknown option...");
+        }
+    }
+    if (quick) {
+        seconds = 0.02;
+    }
+
+    auto dev = aux::device::select(backend);
+    std::cerr << dev.name() << std::endl;
+    bench b{seconds, filter, dev.name()};
+    splat_benchmarks(b, dev, quick);
+    tonemap_benchmarks(b, dev, quick);
+    hue_benchmarks(b);
+    versor_benchmarks(b);
+
+    if (output.empty()) {
+        b.write_json(std::cout);
+    }
+    else {
+        std::ofstream out{std::string(output)};
+        b.write_json(out);
+    }
+    if (baseline.empty() == false) {
+        std::ifstream in{std::string(baseline)};
+        if (in.is_open() == false) {
+            throw std::runtime_error("failed to open the baseline...");
+        }
+        return b.compare(in, tolerance) ? 1 : 0;
+    }
+    return 0;
+}
@@ -6,12 +6,17 @@
 #include <complex>
 #include <cstring>
 #include <cassert>
+#include <cstdint>
+#include <bit>
 
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 
+#ifdef SYCL_LANGUAGE_VERSION
 #include <sycl/sycl.hpp>
+#endif
 
 #include <wayland-client-core.h>
 #include <wayland-client-protocol.h>
@@ -21,6 +26,18 @@
 
 namespace aux::inline algebra
 {
+    // The GCC/Clang vector type a versor<T, N> is also held in, for the versors of the splat and
+    // pack kernels; their arithmetic below goes through it, so it is vector code whatever the
+    // optimizer makes of the recursive apply(). Aligned like T, so that no layout changes.
+    template <class T, size_t N> struct simd { };
+    template <> struct simd<double, 2> { typedef double type __attribute__((vector_size(16), aligned(alignof (double)))); };
+    template <> struct simd<double, 4> { typedef double type __attribute__((vector_size(32), aligned(alignof (double)))); };
+    template <> struct simd<float, 4> { typedef float type __attribute__((vector_size(16), aligned(alignof (float)))); };
+    template <> struct simd<std::uint8_t, 4> { typedef std::uint8_t type __attribute__((vector_size(4), aligned(1))); };
+
+    template <class T, size_t N>
+    concept has_simd = requires { typename simd<T, N>::type; };
+
     template <class T, size_t N>
     struct versor : versor<T, N-1> {
     public:
@@ -96,23 +113,56 @@ namespace aux::inline algebra
             return *this;
         }
 
+    private:
+        // The operators below go through simd<T, N> where there is one, except in constant
+        // evaluation, where bit_cast to a vector type is not guaranteed; element-wise they round
+        // and wrap exactly like the scalar apply(). Division and inner() only for floating point.
+        static constexpr bool vectorized = has_simd<T, N>;
+        static constexpr bool vectorized_float = has_simd<T, N> && std::is_floating_point_v<T>;
+        template <class R>
+        static constexpr bool same = std::is_same_v<std::remove_cvref_t<R>, versor>;
+
+        auto vec() const noexcept { return std::bit_cast<typename simd<T, N>::type>(*this); }
+        auto& assign(auto const& v) noexcept {
+            std::memcpy(static_cast<void*>(this), &v, sizeof v);
+            return *this;
+        }
+
     public:
         constexpr auto operator<=>(versor const& rhs) const noexcept = default;
 
         constexpr auto operator+() const noexcept { return *this; }
 
-        constexpr auto& negate() noexcept { return apply(std::negate<T>()); }
+        constexpr auto& negate() noexcept {
+            if constexpr (vectorized) {
+                if (std::is_constant_evaluated() == false) return assign(-this->vec());
+            }
+            return apply(std::negate<T>());
+        }
         constexpr auto operator-() const noexcept { return (+(*this)).negate(); }
         constexpr auto& lognot() noexcept { return apply(std::bit_not<T>()); }
         constexpr auto operator~() const noexcept { return (+(*this)).lognot(); }
 
-        constexpr auto& operator+=(auto&& rhs) noexcept { return apply(std::plus<T>(), rhs); }
-        constexpr auto& operator-=(auto&& rhs) noexcept { return apply(std::minus<T>(), rhs); }
+        constexpr auto& operator+=(auto&& rhs) noexcept {
+            if constexpr (vectorized && same<decltype (rhs)>) {
+                if (std::is_constant_evaluated() == false) return assign(this->vec() + rhs.vec());
+            }
+            return apply(std::plus<T>(), rhs);
+        }
+        constexpr auto& operator-=(auto&& rhs) noexcept {
+            if constexpr (vectorized && same<decltype (rhs)>) {
+                if (std::is_constant_evaluated() == false) return assign(this->vec() - rhs.vec());
+            }
+            return apply(std::minus<T>(), rhs);
+        }
 
         constexpr auto operator+(auto&& rhs) const noexcept { return (+(*this)) += rhs; }
         constexpr auto operator-(auto&& rhs) const noexcept { return (+(*this)) -= rhs; }
 
         constexpr auto& operator*=(value_type s) noexcept {
+            if constexpr (vectorized) {
+                if (std::is_constant_evaluated() == false) return assign(this->vec() * s);
+            }
             return apply([s](value_type x) noexcept {
                 return x * s;
             });
@@ -121,6 +171,9 @@ namespace aux::inline algebra
         constexpr friend auto operator*(value_type s, versor v) noexcept { return v * s; }
 
         constexpr auto& operator/=(value_type d) noexcept {
+            if constexpr (vectorized_float) {
+                if (std::is_constant_evaluated() == false) return assign(this->vec() / d);
+            }
             return apply([d](value_type x) noexcept {
                 return x / d;
             });
@@ -128,6 +181,17 @@ namespace aux::inline algebra
         constexpr auto operator/(value_type d) const noexcept { return (+(*this)) /= d; }
 
         constexpr friend auto inner(versor const& a, versor const& b) noexcept {
+            if constexpr (vectorized_float) {
+                if (std::is_constant_evaluated() == false) {
+                    // summed in the order of the recursion below, so the result is the same
+                    auto p = a.vec() * b.vec();
+                    T sum = p[0];
+                    for (size_t i = 1; i < N; ++i) {
+                        sum = p[i] + sum;
+                    }
+                    return sum;
+                }
+            }
             return a.last * b.last + inner(static_cast<base_type const&>(a), static_cast<base_type const&>(b));
         }
     };
@@ -178,6 +242,172 @@ namespace aux::inline algebra
 
 } // ::aux::algebra
 
+/////////////////////////////////////////////////////////////////////////////
+#include <span>
+#include <memory>
+#include <functional>
+#include <utility>
+
+namespace aux::inline algebra
+{
+    // N components of versor<T, N> kept each in its own contiguous 64-byte aligned array, for
+    // bulk transforms of many points; apply() and the operators run one component at a time
+    // over all elements, which vectorizes, where a std::vector<versor> goes element by element.
+    // Elements are read and written as versors, gathered from and scattered to the components.
+    template <class T, size_t N>
+    class versor_array {
+        static_assert(std::is_trivially_copyable_v<T>);
+
+    public:
+        using value_type = versor<T, N>;
+        static constexpr size_t ALIGN = 64;
+
+    public:
+        versor_array() noexcept = default;
+        explicit versor_array(size_t n) { this->resize(n); }
+        versor_array(versor_array const& rhs) : versor_array(rhs.n) {
+            for (size_t k = 0; k < N; ++k) {
+                std::copy_n(rhs.data(k), rhs.n, this->data(k));
+            }
+        }
+        versor_array(versor_array&& rhs) noexcept
+            : buffer{std::move(rhs.buffer)}
+            , n{std::exchange(rhs.n, 0)}
+            , stride{std::exchange(rhs.stride, 0)}
+            {
+            }
+        versor_array& operator=(versor_array rhs) noexcept {
+            std::swap(this->buffer, rhs.buffer);
+            std::swap(this->n, rhs.n);
+            std::swap(this->stride, rhs.stride);
+            return *this;
+        }
+
+    public:
+        size_t size() const noexcept { return this->n; }
+        bool empty() const noexcept { return this->n == 0; }
+        size_t capacity() const noexcept { return this->stride; }
+
+        // Grows every component to `capacity` elements at least, rounded up to whole cache lines.
+        void reserve(size_t capacity) {
+            if (capacity <= this->stride) {
+                return;
+            }
+            static constexpr size_t LINE = ALIGN / sizeof (T) ? ALIGN / sizeof (T) : 1;
+            auto const stride = std::max((capacity + LINE - 1) / LINE * LINE, 2 * this->stride);
+            auto buffer = std::unique_ptr<T[], release>{static_cast<T*>(::operator new(N * stride * sizeof (T), std::align_val_t{ALIGN}))};
+            for (size_t k = 0; k < N; ++k) {
+                std::copy_n(this->data(k), this->n, buffer.get() + k * stride);
+            }
+            this->buffer = std::move(buffer);
+            this->stride = stride;
+        }
+        // New elements are zero.
+        void resize(size_t n) {
+            this->reserve(n);
+            for (size_t k = 0; k < N && this->n < n; ++k) {
+                std::fill(this->data(k) + this->n, this->data(k) + n, T());
+            }
+            this->n = n;
+        }
+        void clear() noexcept { this->n = 0; }
+
+        T* data(size_t k) noexcept { return this->buffer.get() + k * this->stride; }
+        T const* data(size_t k) const noexcept { return this->buffer.get() + k * this->stride; }
+        std::span<T> component(size_t k) noexcept { return { this->data(k), this->n }; }
+        std::span<T const> component(size_t k) const noexcept { return { this->data(k), this->n }; }
+
+        value_type operator[](size_t i) const noexcept {
+            value_type v;
+            for (size_t k = 0; k < N; ++k) {
+                v[k] = this->data(k)[i];
+            }
+            return v;
+        }
+        void set(size_t i, value_type const& v) noexcept {
+            for (size_t k = 0; k < N; ++k) {
+                this->data(k)[i] = v[k];
+            }
+        }
+        void push_back(value_type const& v) {
+            this->reserve(this->n + 1);
+            this->set(this->n++, v);
+        }
+
+        // Replaces the elements with proj(e) for every e of the range, which yields versors.
+        template <class Range, class Proj = std::identity>
+        void assign(Range const& range, Proj proj = {}) {
+            this->clear();
+            this->resize(std::size(range));
+            size_t i = 0;
+            for (auto const& e : range) {
+                this->set(i++, std::invoke(proj, e));
+            }
+        }
+        void copy_to(std::span<value_type> out) const noexcept {
+            for (size_t i = 0; i < this->n && i < out.size(); ++i) {
+                out[i] = (*this)[i];
+            }
+        }
+
+    public:
+        // func(element component, rest component...) for every component of every element; each of
+        // the rest is a versor_array of the same size or a versor applied to all elements.
+        template <class Func, class ...Rest>
+        auto& apply(Func&& func, Rest const& ...rest) noexcept {
+            for (size_t k = 0; k < N; ++k) {
+                [&](T* out, auto... in) noexcept {
+#pragma omp simd
+                    for (size_t i = 0; i < this->n; ++i) {
+                        out[i] = func(out[i], in(i)...);
+                    }
+                }(this->data(k), lane(rest, k)...);
+            }
+            return *this;
+        }
+
+        auto& negate() noexcept { return this->apply(std::negate<T>()); }
+        auto operator-() const { return versor_array(*this).negate(); }
+
+        auto& operator+=(auto const& rhs) noexcept { return this->apply(std::plus<T>(), rhs); }
+        auto& operator-=(auto const& rhs) noexcept { return this->apply(std::minus<T>(), rhs); }
+        auto operator+(auto const& rhs) const { return versor_array(*this) += rhs; }
+        auto operator-(auto const& rhs) const { return versor_array(*this) -= rhs; }
+
+        auto& operator*=(T s) noexcept {
+            return this->apply([s](T x) noexcept {
+                return x * s;
+            });
+        }
+        auto& operator/=(T d) noexcept {
+            return this->apply([d](T x) noexcept {
+                return x / d;
+            });
+        }
+        auto operator*(T s) const { return versor_array(*this) *= s; }
+        auto operator/(T d) const { return versor_array(*this) /= d; }
+        friend auto operator*(T s, versor_array const& a) { return a * s; }
+
+    private:
+        static auto lane(versor_array const& a, size_t k) noexcept {
+            return [p = a.data(k)](size_t i) noexcept { return p[i]; };
+        }
+        static auto lane(value_type const& v, size_t k) noexcept {
+            return [s = v[k]](size_t) noexcept { return s; };
+        }
+
+        struct release {
+            void operator()(T* ptr) const noexcept { ::operator delete(ptr, std::align_val_t{ALIGN}); }
+        };
+
+    private:
+        std::unique_ptr<T[], release> buffer;
+        size_t n = 0;
+        size_t stride = 0; // elements between components
+    };
+
+} // ::aux::algebra
+
 /////////////////////////////////////////////////////////////////////////////
 #include <concepts>
 #include <type_traits>
@@ -227,12 +457,15 @@ namespace std
 #include <utility>
 #include <memory>
 #include <string_view>
+#include <limits>
 
 #include <wayland-client.h>
 #include <wayland-client.h>
 
 #include "xdg-shell-client.h"
 #include "zwp-tablet-v2-client.h"
+#include "viewporter-client.h"
+#include "presentation-time-client.h"
 
 
 namespace aux::inline wayland
@@ -258,6 +491,7 @@ namespace aux::inline wayland
     INTERN_CLIENT_LIKE_CONCEPT(wl_surface,            wl_surface_destroy,            wl_surface_listener)
     INTERN_CLIENT_LIKE_CONCEPT(wl_shm_pool,           wl_shm_pool_destroy,           empty_type)
     INTERN_CLIENT_LIKE_CONCEPT(wl_buffer,             wl_buffer_destroy,             wl_buffer_listener)
+    INTERN_CLIENT_LIKE_CONCEPT(wl_callback,           wl_callback_destroy,           wl_callback_listener)
     INTERN_CLIENT_LIKE_CONCEPT(wl_keyboard,           wl_keyboard_destroy,           wl_keyboard_listener)
     INTERN_CLIENT_LIKE_CONCEPT(wl_pointer,            wl_pointer_destroy,            wl_pointer_listener)
     INTERN_CLIENT_LIKE_CONCEPT(wl_touch,              wl_touch_destroy,              wl_touch_listener)
@@ -267,7 +501,15 @@ namespace aux::inline wayland
     INTERN_CLIENT_LIKE_CONCEPT(zwp_tablet_manager_v2, zwp_tablet_manager_v2_destroy, empty_type)
     INTERN_CLIENT_LIKE_CONCEPT(zwp_tablet_seat_v2,    zwp_tablet_seat_v2_destroy,    zwp_tablet_seat_v2_listener)
     INTERN_CLIENT_LIKE_CONCEPT(zwp_tablet_tool_v2,    zwp_tablet_tool_v2_destroy,    zwp_tablet_tool_v2_listener)
+    INTERN_CLIENT_LIKE_CONCEPT(wp_viewporter,         wp_viewporter_destroy,         empty_type)
+    INTERN_CLIENT_LIKE_CONCEPT(wp_viewport,           wp_viewport_destroy,           empty_type)
+    INTERN_CLIENT_LIKE_CONCEPT(wp_presentation,       wp_presentation_destroy,       wp_presentation_listener)
 #undef INTERN_CLIENT_LIKE_CONCEPT
+    // the wp_presentation.feedback request is a function of the same name, which hides the type
+    using presentation_feedback = struct wp_presentation_feedback;
+    template <> constexpr wl_interface const *const interface_ptr<presentation_feedback> = &wp_presentation_feedback_interface;
+    template <> void (*deleter<presentation_feedback>)(presentation_feedback*) = wp_presentation_feedback_destroy;
+    template <> struct listener_type<presentation_feedback> : wp_presentation_feedback_listener { };
 
     template <class T>
     concept client_like_with_listener = client_like<T> && !std::is_base_of_v<empty_type, listener_type<T>>;
@@ -367,37 +609,524 @@ namespace aux::inline wayland
         operator int() const noexcept { return this->fd; }
     };
 
-    template <class T = color, wl_shm_format format = WL_SHM_FORMAT_ARGB8888, size_t bypp = 4>
-    [[nodiscard]] inline auto shm_allocate_buffer(wl_shm* shm, size_t cx, size_t cy) {
-        std::string_view xdg_runtime_dir = std::getenv("XDG_RUNTIME_DIR");
-        if (xdg_runtime_dir.empty() || !std::filesystem::exists(xdg_runtime_dir)) {
-            throw std::runtime_error("No XDG_RUNTIME_DIR settings...");
+    // One memfd shared with the compositor through a single wl_shm_pool, carved into buffers.
+    // It only ever grows, in place where mremap allows, so buffers are recreated after a growth;
+    // the file is sealed against shrinking, which the compositor would otherwise have to guard
+    // against. Pages are optionally huge ("transparent" advises THP, "explicit" takes them from
+    // hugetlbfs, which must have pages reserved) and are faulted in ahead of the first frame.
+    class shm_arena {
+    public:
+        shm_arena(shm_arena const&) = delete;
+        shm_arena& operator=(shm_arena const&) = delete;
+
+        explicit shm_arena(wl_shm* shm, std::string_view hugepages = "transparent")
+            : shm{shm}
+            , transparent{hugepages == "transparent"}
+            {
+                unsigned flags = MFD_CLOEXEC | MFD_ALLOW_SEALING;
+                if (hugepages == "explicit") {
+                    flags |= MFD_HUGETLB;
+                }
+                else if (hugepages != "none" && hugepages != "transparent") {
+                    throw std::runtime_error("unknown hugepages mode...");
+                }
+                this->fd = unique_fd{::memfd_create("othones-shm", flags)};
+                if (this->fd < 0) {
+                    throw std::runtime_error("memfd_create failed...");
+                }
+                struct stat st;
+                if (::fstat(this->fd, &st) < 0) {
+                    throw std::runtime_error("fstat failed...");
+                }
+                this->granularity = st.st_blksize; // the huge page size on hugetlbfs
+                ::fcntl(this->fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_SEAL); // best effort, kernels before 4.16 refuse it on hugetlbfs
+            }
+        ~shm_arena() noexcept {
+            if (this->data) {
+                ::munmap(this->data, this->capacity);
+            }
+        }
+
+        // Makes room for `bytes`; returns true if the mapping moved or the pool grew, after which
+        // previously created buffers and pointers must be recreated.
+        bool reserve(size_t bytes) {
+            if (bytes <= this->capacity) {
+                return false;
+            }
+            auto size = std::max(bytes, this->capacity + this->capacity / 2);
+            size = (size + this->granularity - 1) / this->granularity * this->granularity;
+            if (size > static_cast<size_t>(std::numeric_limits<int32_t>::max())) {
+                throw std::runtime_error("shm pool too large...");
+            }
+            if (::ftruncate(this->fd, size) < 0) {
+                throw std::runtime_error("ftruncate failed...");
+            }
+            void* data = this->data
+                ? ::mremap(this->data, this->capacity, size, MREMAP_MAYMOVE)
+                : ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, 0);
+            if (data == MAP_FAILED) {
+                throw std::runtime_error(this->granularity > 4096 ? "mmap failed, are hugepages reserved?" : "mmap failed...");
+            }
+            auto grown = static_cast<std::byte*>(data) + this->capacity;
+            if (this->transparent) {
+                ::madvise(data, size, MADV_HUGEPAGE);
+            }
+#ifdef MADV_POPULATE_WRITE
+            ::madvise(grown, size - this->capacity, MADV_POPULATE_WRITE); // best effort, since 5.14
+#endif
+            this->data = data;
+            if (this->pool) {
+                wl_shm_pool_resize(this->pool, size);
+            }
+            else {
+                this->pool = wrapper{wl_shm_create_pool(this->shm, this->fd, size)};
+            }
+            this->capacity = size;
+            return true;
+        }
+
+        template <class T, wl_shm_format format, size_t bypp = sizeof (T)>
+        [[nodiscard]] auto create_buffer(size_t offset, size_t cx, size_t cy) {
+            assert(offset + bypp*cx*cy <= this->capacity);
+            return std::pair{
+                wrapper(wl_shm_pool_create_buffer(this->pool, offset, cx, cy, bypp * cx, format)),
+                reinterpret_cast<T*>(static_cast<std::byte*>(this->data) + offset),
+            };
         }
-        std::string tmp_path(xdg_runtime_dir);
-        tmp_path += "/weston-shared-XXXXXX";
-        unique_fd fd{::mkostemp(tmp_path.data(), O_CLOEXEC)};
-        if (fd >= 0) {
-            ::unlink(tmp_path.c_str());
+
+    private:
+        wl_shm* shm;
+        bool transparent;
+        unique_fd fd;
+        size_t granularity = 4096;
+        size_t capacity = 0;
+        void* data = nullptr;
+        wrapper<wl_shm_pool> pool;
+    };
+
+} // ::aux::wayland
+
+
+/////////////////////////////////////////////////////////////////////////////
+
+#include <optional>
+#include <span>
+#include <numeric>
+#include <execution>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+// Where the clear/splat/tonemap stages run: an in-order SYCL queue on a GPU or CPU
+// device, or the native path that spreads the same kernels over the host cores with
+// the parallel algorithms, or with a thread_pool where those would run serially (see
+// OTHONES_TBB in CMakeLists.txt). SYCL is only compiled in by a SYCL compiler (see
+// OTHONES_SYCL_TARGETS there), the native path always is.
+namespace aux::inline compute
+{
+    // Host threads that run f(0) .. f(n-1) between them, the calling thread among them, taking
+    // the next index as they finish one. libstdc++ only runs std::execution::par in parallel on
+    // TBB; without it the native path uses this instead of leaving all cores but one idle.
+    class thread_pool {
+    public:
+        thread_pool(thread_pool const&) = delete;
+        thread_pool& operator=(thread_pool const&) = delete;
+
+        explicit thread_pool(size_t threads) {
+            for (size_t i = 1; i < threads; ++i) {
+                this->workers.emplace_back([this] { this->work(); });
+            }
         }
-        else {
-            throw std::runtime_error("mkostemp failed...");
+        ~thread_pool() noexcept {
+            {
+                std::lock_guard lock{this->mutex};
+                this->quit = true;
+            }
+            this->wake.notify_all();
+            for (auto& worker : this->workers) {
+                worker.join();
+            }
         }
-        if (::ftruncate(fd, bypp*cx*cy) < 0) {
-            throw std::runtime_error("ftruncate failed...");
+
+        size_t size() const noexcept { return this->workers.size() + 1; }
+
+        // returns once every f(i) has
+        template <class F>
+        void run(size_t n, F&& f) {
+            if (n == 0) {
+                return;
+            }
+            {
+                std::lock_guard lock{this->mutex};
+                this->call = [](void* f, size_t i) { (*static_cast<std::remove_reference_t<F>*>(f))(i); };
+                this->f = &f;
+                this->n = n;
+                this->next = 0;
+                this->running = this->workers.size();
+                ++this->generation;
+            }
+            this->wake.notify_all();
+            this->drain();
+            std::unique_lock lock{this->mutex};
+            this->done.wait(lock, [this] { return this->running == 0; });
         }
-        void* data = mmap(nullptr, bypp*cx*cy, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-        if (data == MAP_FAILED) {
-            throw std::runtime_error("mmap failed...");
+
+    private:
+        void drain() noexcept {
+            for (size_t i; (i = this->next.fetch_add(1, std::memory_order_relaxed)) < this->n; ) {
+                this->call(this->f, i);
+            }
+        }
+        void work() noexcept {
+            size_t seen = 0;
+            std::unique_lock lock{this->mutex};
+            for (;;) {
+                this->wake.wait(lock, [&] { return this->quit || this->generation != seen; });
+                if (this->quit) {
+                    return;
+                }
+                seen = this->generation;
+                lock.unlock();
+                this->drain();
+                lock.lock();
+                if (--this->running == 0) {
+                    this->done.notify_one();
+                }
+            }
+        }
+
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable done;
+        bool quit = false;
+        size_t generation = 0; // of run() calls, the workers wake for a new one
+        size_t running = 0;    // workers not through the current run() yet
+        void (*call)(void*, size_t) = nullptr;
+        void* f = nullptr;
+        size_t n = 0;
+        std::atomic<size_t> next = 0;
+    };
+
+    // work-items of one group, i.e. pixels of one TILE x TILE screen tile
+    inline constexpr size_t GROUP = 256;
+
+    // What a group kernel sees of its work-item: the group, the item within it and the
+    // group's shared counters, which only fetch() and add() may touch while items race.
+    template <class Local, bool Atomic>
+    struct group_item {
+        size_t group;
+        size_t local_id;
+        Local local;
+
+        uint32_t& operator[](size_t k) const noexcept { return local[k]; }
+        uint32_t fetch(size_t k) const noexcept {
+            if constexpr (Atomic) return ref(k).load();
+            else                  return local[k];
+        }
+        void add(size_t k, uint32_t w) const noexcept {
+            if constexpr (Atomic) ref(k).fetch_add(w);
+            else                  local[k] += w;
+        }
+
+    private:
+        auto ref(size_t k) const noexcept {
+#ifdef SYCL_LANGUAGE_VERSION
+            return sycl::atomic_ref<uint32_t,
+                                    sycl::memory_order::relaxed,
+                                    sycl::memory_scope::work_group,
+                                    sycl::access::address_space::local_space>(local[k]);
+#else
+            return std::atomic_ref<uint32_t>(local[k]);
+#endif
+        }
+    };
+
+#ifdef SYCL_LANGUAGE_VERSION
+    using half = sycl::half;
+#else
+    using half = _Float16;
+#endif
+
+    class device {
+    public:
+        // "gpu" and "cpu" pick a SYCL device of that kind, "native" the host cores; "auto" prefers
+        // a GPU, then a SYCL CPU device, then the native path. With `profiling`, busy_ms() reports
+        // how long the device worked.
+        static device select(std::string_view backend, bool profiling = false) {
+            auto dev = open(backend, profiling);
+            dev.profiling = profiling;
+            return dev;
+        }
+
+        // Device time of the copies and kernels issued since the last call, in ms, or 0 without
+        // profiling: from the queue's profiling events on a SYCL device, which it waits for, and
+        // from host timers around the calls on the native path.
+        double busy_ms() {
+#ifdef SYCL_LANGUAGE_VERSION
+            if (this->que && this->profiling) {
+                this->que->wait();
+                for (auto const& e : this->events) {
+                    using sycl::info::event_profiling;
+                    this->busy += std::chrono::nanoseconds(e.get_profiling_info<event_profiling::command_end>() -
+                                                           e.get_profiling_info<event_profiling::command_start>());
+                }
+                this->events.clear();
+            }
+#endif
+            return std::chrono::duration<double, std::milli>(std::exchange(this->busy, {})).count();
+        }
+
+        std::string name() const {
+#ifdef SYCL_LANGUAGE_VERSION
+            if (this->que) {
+                auto dev = this->que->get_device();
+                return dev.get_info<sycl::info::device::name>() + " (" + dev.get_info<sycl::info::device::vendor>() + ")";
+            }
+#endif
+#ifdef OTHONES_TBB
+            return "native, " + std::to_string(std::thread::hardware_concurrency()) + " threads on TBB";
+#else
+            return "native, " + std::to_string(std::thread::hardware_concurrency()) + " threads in a pool";
+#endif
+        }
+
+        // whether kernels may write host memory, such as the shm mapping, directly
+        bool host_accessible() const {
+#ifdef SYCL_LANGUAGE_VERSION
+            if (this->que) {
+                return this->que->get_device().has(sycl::aspect::usm_system_allocations);
+            }
+#endif
+            return true;
+        }
+
+        template <class T>
+        T* allocate(size_t n) {
+#ifdef SYCL_LANGUAGE_VERSION
+            if (this->que) {
+                return sycl::malloc_device<T>(n, *this->que);
+            }
+#endif
+            return static_cast<T*>(::operator new(n * sizeof (T), std::align_val_t{64}));
+        }
+        void deallocate(void* ptr) noexcept {
+#ifdef SYCL_LANGUAGE_VERSION
+            if (this->que) {
+                return sycl::free(ptr, *this->que);
+            }
+#endif
+            ::operator delete(ptr, std::align_val_t{64});
+        }
+
+        void memcpy(void* dst, void const* src, size_t bytes) {
+#ifdef SYCL_LANGUAGE_VERSION
+            if (this->que) {
+                this->track(this->que->memcpy(dst, src, bytes));
+                return;
+            }
+#endif
+            busy_timer timer{this};
+            std::memcpy(dst, src, bytes);
+        }
+        void memset(void* dst, int value, size_t bytes) {
+#ifdef SYCL_LANGUAGE_VERSION
+            if (this->que) {
+                this->track(this->que->memset(dst, value, bytes));
+                return;
+            }
+#endif
+            busy_timer timer{this};
+            std::memset(dst, value, bytes);
+        }
+        // native work is done by the time its call returns
+        void wait() {
+#ifdef SYCL_LANGUAGE_VERSION
+            if (this->que) {
+                this->que->wait();
+            }
+#endif
+        }
+
+        // kernel(row, col) over a rows x cols range
+        template <class Kernel>
+        void for_each(size_t rows, size_t cols, Kernel kernel) {
+#ifdef SYCL_LANGUAGE_VERSION
+            if (this->que) {
+                this->track(this->que->parallel_for(sycl::range<2>{rows, cols}, [=](sycl::item<2> it) noexcept {
+                    kernel(it[0], it[1]);
+                }));
+                return;
+            }
+#endif
+            busy_timer timer{this};
+            this->parallel(rows, [&](size_t row) noexcept {
+#pragma omp simd
+                for (size_t col = 0; col < cols; ++col) {
+                    kernel(row, col);
+                }
+            });
+        }
+
+        // kernel(phase, item) for GROUP work-items in each of the groups, phase by phase with a
+        // barrier in between, the items of a group sharing LOCAL counters zeroed by the kernel.
+        // A native group is one task that runs its items in turn, so its counters need no atomics.
+        template <size_t PHASES, size_t LOCAL, class Kernel>
+        void for_groups(size_t groups, Kernel kernel) {
+#ifdef SYCL_LANGUAGE_VERSION
+            if (this->que) {
+                this->track(this->que->submit([&](sycl::handler& h) noexcept {
+                    auto local = sycl::local_accessor<uint32_t, 1>{sycl::range<1>{std::max<size_t>(LOCAL, 1)}, h};
+                    auto range = sycl::nd_range<1>{sycl::range<1>{groups * GROUP}, sycl::range<1>{GROUP}};
+                    h.parallel_for(range, [=](sycl::nd_item<1> it) noexcept {
+                        auto item = group_item<decltype (local), true>{it.get_group_linear_id(), it.get_local_linear_id(), local};
+                        for (size_t phase = 0; phase < PHASES; ++phase) {
+                            if (phase) {
+                                sycl::group_barrier(it.get_group());
+                            }
+                            kernel(phase, item);
+                        }
+                    });
+                }));
+                return;
+            }
+#endif
+            busy_timer timer{this};
+            this->parallel(groups, [&](size_t group) noexcept {
+                std::array<uint32_t, std::max<size_t>(LOCAL, 1)> local;
+                for (size_t phase = 0; phase < PHASES; ++phase) {
+                    for (size_t l = 0; l < GROUP; ++l) {
+                        kernel(phase, group_item<uint32_t*, false>{group, l, local.data()});
+                    }
+                }
+            });
+        }
+
+    private:
+        static device open(std::string_view backend, [[maybe_unused]] bool profiling) {
+#ifdef SYCL_LANGUAGE_VERSION
+            auto open = [profiling](auto selector) {
+                auto properties = profiling
+                    ? sycl::property_list{sycl::property::queue::in_order{}, sycl::property::queue::enable_profiling{}}
+                    : sycl::property_list{sycl::property::queue::in_order{}};
+                return device{sycl::queue{selector, properties}};
+            };
+            if (backend == "gpu") return open(sycl::gpu_selector_v);
+            if (backend == "cpu") return open(sycl::cpu_selector_v);
+            if (backend == "auto") {
+                for (auto selector : { sycl::gpu_selector_v, sycl::cpu_selector_v }) {
+                    try {
+                        return open(selector);
+                    }
+                    catch (sycl::exception const&) {
+                    }
+                }
+                return device{};
+            }
+#else
+            if (backend == "auto") return device{};
+#endif
+            if (backend == "native") return device{};
+            throw std::runtime_error("unknown or unavailable backend...");
         }
-        return std::tuple{
-            std::move(fd),
-            wrapper(wl_shm_pool_create_buffer(wrapper(wl_shm_create_pool(shm, fd, bypp*cx*cy)),
-                                              0, cx, cy, bypp * cx, format)),
-            static_cast<T*>(data),
+
+        // Charges the native call it lives through to busy_ms().
+        struct busy_timer {
+            device* dev;
+            std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+            ~busy_timer() noexcept {
+                if (this->dev->profiling) {
+                    this->dev->busy += std::chrono::steady_clock::now() - this->t0;
+                }
+            }
         };
+#ifdef SYCL_LANGUAGE_VERSION
+        void track(sycl::event e) {
+            if (this->profiling) {
+                this->events.push_back(std::move(e));
+            }
+        }
+#endif
+
+        // f(0) .. f(n-1) over the host cores
+        template <class F>
+        void parallel(size_t n, F f) {
+#ifdef OTHONES_TBB
+            // the parallel algorithms only split random-access ranges
+            std::vector<size_t> rng(n);
+            std::iota(rng.begin(), rng.end(), size_t{0});
+            std::for_each(std::execution::par, rng.begin(), rng.end(), f);
+#else
+            if (this->pool == nullptr) {
+                this->pool = std::make_shared<thread_pool>(std::max(std::thread::hardware_concurrency(), 1u));
+            }
+            this->pool->run(n, f);
+#endif
+        }
+
+#ifdef SYCL_LANGUAGE_VERSION
+        explicit device(sycl::queue que) : que{std::move(que)} { }
+        std::optional<sycl::queue> que;
+        std::vector<sycl::event> events; // profiled, not yet charged to busy
+#endif
+        device() = default;
+        bool profiling = false;
+        std::chrono::steady_clock::duration busy{};
+#ifndef OTHONES_TBB
+        std::shared_ptr<thread_pool> pool; // started by the first native kernel
+#endif
+    };
+
+    struct device_deleter {
+        device* dev;
+        void operator()(void* ptr) const noexcept { dev->deallocate(ptr); }
+    };
+    template <class T>
+    using unique_device = std::unique_ptr<T, device_deleter>;
+
+    template <class T>
+    auto allocate(size_t n, device& dev) {
+        return unique_device<T>{ dev.allocate<T>(n), device_deleter{&dev} };
     }
 
-} // ::aux::wayland
+    // Device array that keeps its allocation across assignments and only grows,
+    // so per-frame uploads cost a copy but never an allocation.
+    template <class T>
+    class device_vector {
+    public:
+        explicit device_vector(device& dev) noexcept
+            : ptr{nullptr, device_deleter{&dev}}
+            {
+            }
+
+        auto data() const noexcept { return this->ptr.get(); }
+        auto size() const noexcept { return this->count; }
+
+        void resize(size_t n) {
+            if (this->capacity < n) {
+                this->ptr = compute::allocate<T>(n, *this->ptr.get_deleter().dev);
+                this->capacity = n;
+            }
+            this->count = n;
+        }
+        void assign(std::span<T const> host) {
+            this->resize(host.size());
+            this->ptr.get_deleter().dev->memcpy(this->data(), host.data(), host.size_bytes());
+        }
+        // overwrites [offset, offset + host.size()), which must lie within size()
+        void write(size_t offset, std::span<T const> host) {
+            this->ptr.get_deleter().dev->memcpy(this->data() + offset, host.data(), host.size_bytes());
+        }
+
+    private:
+        unique_device<T> ptr;
+        size_t capacity = 0;
+        size_t count = 0;
+    };
+
+} // ::aux::compute
 
 inline auto lamed() noexcept {
     return [](auto...) noexcept { };
@@ -434,26 +1163,1712 @@ constexpr aux::versor<uint8_t, 4> hue(uint32_t h) noexcept {
     return {0, 0, 0, A};
 }
 
-#include <set>
+/////////////////////////////////////////////////////////////////////////////
+#include <numbers>
+
+// One sample of the golden-angle spiral splatted around every vertex;
+// it depends only on the sample index, N and D, never on the vertex.
+struct spiral_sample {
+    aux::vec2d offset;
+    aux::versor<uint8_t, 4> weight; // {b, g, r, a} as returned by hue()
+};
+
+inline auto phyllotaxis(uint32_t N, double D) {
+    static constexpr double TAU = 2.0 * std::numbers::pi;
+    static constexpr double PSI = 1.0 / std::numbers::phi;
+
+    std::vector<spiral_sample> table(N);
+    for (uint32_t i = 0; i < N; ++i) {
+        auto theta = std::polar(std::sqrt(1.0+i)/D, (1+i) * TAU * PSI);
+        double d = 1.0 - static_cast<double>(i+1)/N;
+        table[i] = { {theta.real(), theta.imag()}, hue(d*1530) };
+    }
+    return table;
+}
 
-#include <cairo/cairo.h>
-#include <linux/input-event-codes.h>
+// Radius of the outermost spiral sample, i.e. how far a vertex can reach.
+inline double spiral_reach(uint32_t N, double D) noexcept {
+    return std::sqrt(static_cast<double>(N)) / D;
+}
 
-int main(int, char** argv) {
-    using namespace aux;
-    auto display = wrapper{wl_display_connect(nullptr)};
-    auto registry = wrapper{wl_display_get_registry(display)};
+// The spiral samples bucketed by the unit cell their offset falls in, so that the
+// gather kernel can find the few samples of a vertex that may land on a given pixel.
+struct spiral_grid {
+    int32_t radius;                // cells cover offsets [-radius, radius) on both axes
+    std::vector<uint32_t> first;   // samples[first[c], first[c+1]) lie in cell c, row-major
+    std::vector<uint32_t> samples; // sample indices
+};
+
+inline auto grid_samples(std::span<spiral_sample const> table) {
+    double reach = 0;
+    for (auto const& sample : table) {
+        reach = std::max({reach, std::abs(sample.offset[0]), std::abs(sample.offset[1])});
+    }
+    spiral_grid grid{static_cast<int32_t>(std::ceil(reach)) + 1, {}, {}};
+    auto const side = 2 * grid.radius;
+    auto cell_of = [&](spiral_sample const& sample) noexcept {
+        auto kx = static_cast<int32_t>(std::floor(sample.offset[0])) + grid.radius;
+        auto ky = static_cast<int32_t>(std::floor(sample.offset[1])) + grid.radius;
+        return static_cast<size_t>(ky * side + kx);
+    };
+    grid.first.assign(side * side + 1, 0);
+    for (auto const& sample : table) {
+        ++grid.first[cell_of(sample) + 1];
+    }
+    std::partial_sum(grid.first.begin(), grid.first.end(), grid.first.begin());
+    grid.samples.resize(table.size());
+    auto fill = grid.first;
+    for (uint32_t i = 0; i < table.size(); ++i) {
+        grid.samples[fill[cell_of(table[i])]++] = i;
+    }
+    return grid;
+}
 
-    wrapper<wl_compositor> compositor;
-    wrapper<wl_shm> shm;
+/////////////////////////////////////////////////////////////////////////////
+#include <span>
+#include <algorithm>
+#include <numeric>
+
+// The canvas is split into TILE x TILE screen tiles; one work-group owns a tile,
+// accumulates it in local memory and flushes it once, so no two work-items ever
+// add into the same global pixel.
+inline constexpr size_t TILE = 16;
+
+// Mean number of vertices binned per touched tile from which the gather kernel
+// is used instead of scatter: past it the local atomics of a tile keep hitting
+// the same few pixels, while gathering stays conflict free.
+inline constexpr size_t GATHER_DENSITY = 64;
+
+// A vertex standing for `weight` samples at the same place: the splat adds its spiral that many times.
+struct weighted_vertex {
+    aux::vec2d position;
+    uint32_t weight = 1;
+};
+
+struct tile_bins {
+    std::vector<uint32_t> tiles;   // touched tiles, row-major ids over the tile grid
+    std::vector<uint32_t> first;   // entries[first[k], first[k+1]) reach tiles[k]
+    std::vector<uint32_t> entries; // vertex indices
+};
+
+// `origin` is where the canvas lies in the image the scaled vertices are placed in.
+inline auto bin_vertices(std::span<weighted_vertex const> vertices, double zoom, double reach, size_t cx, size_t cy, aux::vec2d origin = {}) {
+    auto const nx = (cx + TILE - 1) / TILE;
+    auto const ny = (cy + TILE - 1) / TILE;
+    auto tile_of = [](double p) noexcept {
+        return static_cast<ptrdiff_t>(std::floor(p / TILE));
+    };
+    std::vector<std::pair<uint32_t, uint32_t>> pairs; // {tile, vertex}, sorted to keep the order deterministic
+    for (uint32_t v = 0; v < vertices.size(); ++v) {
+        auto [x, y] = vertices[v].position * zoom - origin;
+        auto x0 = std::max<ptrdiff_t>(tile_of(x - reach), 0);
+        auto y0 = std::max<ptrdiff_t>(tile_of(y - reach), 0);
+        auto x1 = std::min<ptrdiff_t>(tile_of(x + reach), nx - 1);
+        auto y1 = std::min<ptrdiff_t>(tile_of(y + reach), ny - 1);
+        for (auto ty = y0; ty <= y1; ++ty) {
+            for (auto tx = x0; tx <= x1; ++tx) {
+                pairs.emplace_back(ty * nx + tx, v);
+            }
+        }
+    }
+    std::sort(pairs.begin(), pairs.end());
+
+    tile_bins bins;
+    bins.entries.reserve(pairs.size());
+    for (auto [tile, v] : pairs) {
+        if (bins.tiles.empty() || bins.tiles.back() != tile) {
+            bins.tiles.push_back(tile);
+            bins.first.push_back(bins.entries.size());
+        }
+        bins.entries.push_back(v);
+    }
+    bins.first.push_back(bins.entries.size());
+    return bins;
+}
 
-    wrapper<wl_seat> seat;
-    wrapper<wl_pointer> pointer;
-    wrapper<wl_keyboard> keyboard;
-    wrapper<wl_touch> touch;
-    bool quit = false;
+/////////////////////////////////////////////////////////////////////////////
 
-    wrapper<xdg_wm_base> shell;
+// A handful of rectangles in buffer pixels. Touching rectangles are merged when
+// their union wastes no more than their combined area, so a diagonal stroke stays
+// a staircase of boxes; past MAX the whole region collapses into its bounding box.
+class damage_region {
+public:
+    struct rect {
+        int32_t x0 = 0, y0 = 0, x1 = 0, y1 = 0; // half-open
+
+        constexpr bool empty() const noexcept { return x1 <= x0 || y1 <= y0; }
+        constexpr int64_t area() const noexcept { return empty() ? 0 : int64_t(x1 - x0) * (y1 - y0); }
+        constexpr friend rect operator|(rect const& a, rect const& b) noexcept {
+            if (a.empty()) return b;
+            if (b.empty()) return a;
+            return { std::min(a.x0, b.x0), std::min(a.y0, b.y0), std::max(a.x1, b.x1), std::max(a.y1, b.y1) };
+        }
+        constexpr bool touches(rect const& r) const noexcept {
+            return x0 <= r.x1 && r.x0 <= x1 && y0 <= r.y1 && r.y0 <= y1;
+        }
+    };
+    static constexpr size_t MAX = 16;
+
+public:
+    void add(rect r) {
+        if (r.empty()) {
+            return;
+        }
+        for (auto it = this->rects.begin(); it != this->rects.end(); ) {
+            if (it->touches(r) && (r | *it).area() <= r.area() + it->area()) {
+                r = r | *it;
+                this->rects.erase(it);
+                it = this->rects.begin(); // the grown rectangle may touch the ones already passed
+            }
+            else {
+                ++it;
+            }
+        }
+        this->rects.push_back(r);
+        if (this->rects.size() > MAX) {
+            this->rects = { this->bounds() };
+        }
+    }
+    rect bounds() const noexcept {
+        return std::accumulate(this->rects.begin(), this->rects.end(), rect{}, std::bit_or<>());
+    }
+    bool empty() const noexcept { return this->rects.empty(); }
+    auto begin() const noexcept { return this->rects.begin(); }
+    auto end() const noexcept { return this->rects.end(); }
+
+private:
+    std::vector<rect> rects;
+};
+
+// Pixels a vertex can splat into, clipped to the cx x cy canvas.
+inline auto reach_bounds(aux::vec2d const& v, double reach, size_t cx, size_t cy) noexcept {
+    auto clip = [](double p, size_t n) noexcept {
+        return static_cast<int32_t>(std::clamp(p, 0.0, static_cast<double>(n)));
+    };
+    auto [x, y] = v;
+    return damage_region::rect{
+        clip(std::floor(x - reach), cx),
+        clip(std::floor(y - reach), cy),
+        clip(std::floor(x + reach) + 1, cx),
+        clip(std::floor(y + reach) + 1, cy),
+    };
+}
+
+/////////////////////////////////////////////////////////////////////////////
+#include <variant>
+
+
+// Per-pixel RGB accumulators (the alpha sum was never read). Every weight is an
+// integer and the tonemap curve cannot tell counts past SATURATION apart, even
+// for 10-bit output, so all formats saturate there and stay exact below it.
+inline constexpr uint32_t SATURATION = 1023;
+
+// The tonemap curve M - M/(c+1) of an output channel of the given depth, M = 2^bits - 1, for
+// the integer counts up to SATURATION, scaled by `gain` first. Counts saturate there, so even
+// below a gain of 1 every count has its own entry and the brightest pixels keep their tone.
+inline auto tone_curve(uint32_t bits, float gain = 1) {
+    uint32_t const M = (1u << bits) - 1;
+    std::vector<uint16_t> lut(SATURATION + 1);
+    for (uint32_t c = 0; c <= SATURATION; ++c) {
+        lut[c] = static_cast<uint16_t>(M - static_cast<float>(M) / (c * gain + 1));
+    }
+    return lut;
+}
+
+// Layouts of an shm buffer pixel: alpha or padding on top, then R, G and B channels of the
+// given depths down to the least significant bit, which covers every format offered here.
+template <class T, wl_shm_format F, uint32_t R, uint32_t G, uint32_t B, T ALPHA>
+struct shm_pixel {
+    using value_type = T;
+    static constexpr wl_shm_format format = F;
+    static constexpr std::array<uint32_t, 3> depth = { R, G, B };
+
+    // `lut` holds the curves of the R, G and B depths one after another, see tone_curve()
+    static constexpr value_type pack(uint16_t const* lut, uint32_t r, uint32_t g, uint32_t b) noexcept {
+        auto tone = [lut](uint32_t curve, uint32_t c) noexcept -> T {
+            return lut[curve * (SATURATION + 1) + std::min(c, SATURATION)];
+        };
+        return ALPHA
+            | tone(0, r) << (G + B)
+            | tone(1, g) << B
+            | tone(2, b);
+    }
+};
+
+struct argb8888    : shm_pixel<uint32_t, WL_SHM_FORMAT_ARGB8888,     8,  8,  8, 0xff000000> { static constexpr std::string_view name = "argb8888"; };
+struct xrgb8888    : shm_pixel<uint32_t, WL_SHM_FORMAT_XRGB8888,     8,  8,  8, 0>          { static constexpr std::string_view name = "xrgb8888"; };
+struct rgb565      : shm_pixel<uint16_t, WL_SHM_FORMAT_RGB565,       5,  6,  5, 0>          { static constexpr std::string_view name = "rgb565"; };
+struct xrgb2101010 : shm_pixel<uint32_t, WL_SHM_FORMAT_XRGB2101010, 10, 10, 10, 0>          { static constexpr std::string_view name = "xrgb2101010"; };
+
+using any_pixel = std::variant<xrgb8888, argb8888, rgb565, xrgb2101010>;
+
+// "auto" picks from the formats the compositor advertised: XRGB2101010 when it is among them, as
+// it keeps all the bits of the counters, and else XRGB8888, which every compositor supports and
+// whose padding byte is never written.
+inline any_pixel make_pixel(std::string_view format, std::span<uint32_t const> advertised = {}) {
+    if (format == "auto") {
+        if (std::ranges::find(advertised, xrgb2101010::format) != advertised.end()) return xrgb2101010{};
+        return xrgb8888{};
+    }
+    if (format == xrgb8888::name)                     return xrgb8888{};
+    if (format == argb8888::name)                     return argb8888{};
+    if (format == rgb565::name)                       return rgb565{};
+    if (format == xrgb2101010::name)                  return xrgb2101010{};
+    throw std::runtime_error("unknown pixel format...");
+}
+
+// Three saturating 10-bit counters packed into one word: 4 bytes per pixel.
+struct packed_rgb {
+    using value_type = uint32_t;
+    static constexpr std::string_view name = "packed";
+
+    static constexpr aux::versor<uint32_t, 3> load(value_type acc) noexcept {
+        return { acc >> 20 & SATURATION, acc >> 10 & SATURATION, acc & SATURATION };
+    }
+    static constexpr value_type add(value_type acc, uint32_t r, uint32_t g, uint32_t b) noexcept {
+        auto [r0, g0, b0] = load(acc);
+        r = std::min(r0 + r, SATURATION);
+        g = std::min(g0 + g, SATURATION);
+        b = std::min(b0 + b, SATURATION);
+        return r << 20 | g << 10 | b;
+    }
+};
+
+// Interleaved floating-point counters, 12 bytes per pixel as float and 6 as half.
+template <class T>
+struct float_rgb {
+    using value_type = aux::versor<T, 3>;
+    static constexpr std::string_view name = sizeof (T) == 2 ? "half" : "float";
+
+    static constexpr aux::versor<float, 3> load(value_type acc) noexcept {
+        return { static_cast<float>(acc[0]), static_cast<float>(acc[1]), static_cast<float>(acc[2]) };
+    }
+    static constexpr value_type add(value_type acc, uint32_t r, uint32_t g, uint32_t b) noexcept {
+        auto [r0, g0, b0] = load(acc);
+        return {
+            std::min(r0 + r, static_cast<float>(SATURATION)),
+            std::min(g0 + g, static_cast<float>(SATURATION)),
+            std::min(b0 + b, static_cast<float>(SATURATION)),
+        };
+    }
+};
+
+// The spiral table and its cell grid on the device, for the current N and D.
+// `zoom` is the canvas pixels per input pixel: vertices are scaled by it and the spiral grows with
+// them, so a canvas rendered below the input resolution shows the same picture, only coarser.
+struct spiral {
+    aux::device& dev;
+    uint32_t N = 0;
+    double D = 0;
+    double zoom = 1;
+    double reach = 0;
+    int32_t radius = 0;
+    aux::device_vector<spiral_sample> table{dev};
+    aux::device_vector<uint32_t> cell_first{dev};
+    aux::device_vector<uint32_t> cell_samples{dev};
+
+    void assign(uint32_t N, double D, double zoom = 1) {
+        auto samples = phyllotaxis(N, D / zoom);
+        auto grid = grid_samples(samples);
+        this->table.assign(samples);
+        this->cell_first.assign(grid.first);
+        this->cell_samples.assign(grid.samples);
+        this->N = N;
+        this->D = D;
+        this->zoom = zoom;
+        this->reach = spiral_reach(N, D / zoom);
+        this->radius = grid.radius;
+        this->dev.wait(); // the host tables go away at the end of this scope
+    }
+};
+
+// The accumulation channels of a cx x cy canvas and the clear/splat/tonemap stages over them.
+template <class Format>
+class canvas {
+public:
+    using value_type = typename Format::value_type;
+
+public:
+    canvas(aux::device& dev, size_t cx, size_t cy)
+        : dev{dev}
+        , counts{dev}
+        , fresh_vertices{dev}
+        , bin_tiles{dev}
+        , bin_first{dev}
+        , bin_entries{dev}
+        , tones{dev}
+        , direct{dev.host_accessible()}
+        , frame_pixels{dev}
+        {
+            this->resize(cx, cy);
+        }
+
+    // the contents are undefined until the next clear().
+    void resize(size_t cx, size_t cy) {
+        this->cx = cx;
+        this->cy = cy;
+        this->counts.resize(cx*cy);
+    }
+
+    // A canvas at zoom z (see spiral) collects about 1/z^2 as many samples per pixel as one at the
+    // input resolution; tonemapping with a gain of z^2 keeps the two equally bright.
+    void expose(float gain) {
+        if (this->tone_gain != gain) {
+            this->tone_gain = gain;
+            this->tone_format = ~0u;
+        }
+    }
+
+    // Makes the canvas the cx x cy window at (x, y) of a larger image, such as a poster tile; the
+    // vertices stay in the coordinates of the image. The window of a frame is at the origin.
+    void move_to(size_t x, size_t y) noexcept {
+        this->ox = x;
+        this->oy = y;
+    }
+
+    void clear() {
+        this->dev.memset(this->counts.data(), 0, this->cx*this->cy * sizeof (value_type));
+    }
+
+    // `resident`, when given, is a device copy of `vertices` that is read instead of uploading them.
+    // Only the spiral samples [s0, s1) are splatted; the inner ones reach less far, so the vertices
+    // are binned by the reach of the last of them.
+    void splat(spiral const& sp, std::span<weighted_vertex const> vertices, weighted_vertex const* resident = nullptr, uint32_t s0 = 0, uint32_t s1 = ~0u) {
+        s1 = std::min(s1, sp.N);
+        if (s1 <= s0) {
+            return;
+        }
+        auto const reach = s1 == sp.N ? sp.reach : spiral_reach(s1, sp.D / sp.zoom);
+        auto bins = bin_vertices(vertices, sp.zoom, reach, this->cx, this->cy, { static_cast<double>(this->ox), static_cast<double>(this->oy) });
+        if (bins.tiles.empty()) {
+            return;
+        }
+        if (resident == nullptr) {
+            this->fresh_vertices.assign(vertices);
+            resident = this->fresh_vertices.data();
+        }
+        this->bin_tiles.assign(bins.tiles);
+        this->bin_first.assign(bins.first);
+        this->bin_entries.assign(bins.entries);
+        auto acc = this->counts.data();
+        auto vtx = resident;
+        auto tiles = this->bin_tiles.data();
+        auto first = this->bin_first.data();
+        auto entries = this->bin_entries.data();
+        auto tbl = sp.table.data();
+        auto cfirst = sp.cell_first.data();
+        auto csamples = sp.cell_samples.data();
+        int32_t const R = sp.radius;
+        auto zoom = sp.zoom;
+        auto cx = this->cx;
+        auto cy = this->cy;
+        auto ox = this->ox;
+        auto oy = this->oy;
+        auto nx = (cx + TILE - 1) / TILE;
+        constexpr size_t TT = TILE * TILE;
+        static_assert(TT == aux::GROUP);
+
+        if (bins.entries.size() >= GATHER_DENSITY * bins.tiles.size()) {
+            // gather: every work-item owns one pixel of the tile and looks up, for each
+            // binned vertex, only the spiral cells that can land on it.
+            this->dev.for_groups<1, 0>(bins.tiles.size(), [=](size_t, auto const& it) noexcept {
+                auto g = it.group;
+                auto l = it.local_id;
+                // x and y in the image, see move_to()
+                size_t const x = ox + tiles[g] % nx * TILE + l % TILE;
+                size_t const y = oy + tiles[g] / nx * TILE + l / TILE;
+                if (!(0 < x && x - ox < cx && 0 < y && y - oy < cy)) {
+                    return;
+                }
+                constexpr double eps = 1.0 / 1024;
+                uint32_t r = 0, gg = 0, b = 0;
+                for (auto e = first[g]; e < first[g+1]; ++e) {
+                    auto v = vtx[entries[e]].position * zoom;
+                    auto times = std::min(vtx[entries[e]].weight, SATURATION);
+                    // offsets that land on this pixel are within [x - v, x - v + 1), give or take the
+                    // rounding of v + offset, so the cells of [x - v - eps, x - v + 1 + eps) are looked in
+                    auto const ax = x - v[0];
+                    auto const ay = y - v[1];
+                    auto kx0 = static_cast<int32_t>(std::floor(ax - eps)) + R;
+                    auto ky0 = static_cast<int32_t>(std::floor(ay - eps)) + R;
+                    auto kx1 = static_cast<int32_t>(std::floor(ax + eps)) + R + 1;
+                    auto ky1 = static_cast<int32_t>(std::floor(ay + eps)) + R + 1;
+                    for (auto ky = std::max(ky0, 0); ky <= std::min(ky1, 2*R - 1); ++ky) {
+                        for (auto kx = std::max(kx0, 0); kx <= std::min(kx1, 2*R - 1); ++kx) {
+                            auto c = ky * 2*R + kx;
+                            for (auto s = cfirst[c]; s < cfirst[c+1]; ++s) {
+                                auto i = csamples[s];
+                                if (i < s0 || s1 <= i) {
+                                    continue;
+                                }
+                                auto pt = v + tbl[i].offset;
+                                if (static_cast<size_t>(pt[0]) == x && static_cast<size_t>(pt[1]) == y) {
+                                    auto w = tbl[i].weight;
+                                    r = std::min<uint32_t>(r + w[2] * times, SATURATION);
+                                    gg = std::min<uint32_t>(gg + w[1] * times, SATURATION);
+                                    b = std::min<uint32_t>(b + w[0] * times, SATURATION);
+                                }
+                            }
+                        }
+                    }
+                }
+                auto const idx = (y - oy)*cx + (x - ox);
+                acc[idx] = Format::add(acc[idx], r, gg, b);
+            });
+        }
+        else {
+            // scatter: the three channels of the tile counted in integers, every weight is an integer,
+            // so the sums do not depend on the order the work-items add them in. A work-item takes
+            // one row of spiral cells of a binned vertex, of which only the cells over the tile are
+            // looked in; in row-major order their samples are one contiguous run of the grid.
+            this->dev.for_groups<3, 3 * TT>(bins.tiles.size(), [=](size_t phase, auto const& it) noexcept {
+                auto g = it.group;
+                auto l = it.local_id;
+                size_t const x0 = ox + tiles[g] % nx * TILE; // in the image, see move_to()
+                size_t const y0 = oy + tiles[g] / nx * TILE;
+                if (phase == 0) {
+                    for (size_t c = 0; c < 3; ++c) {
+                        it[c*TT + l] = 0;
+                    }
+                }
+                else if (phase == 1) {
+                    auto add = [&](size_t k, uint32_t w) noexcept {
+                        if (it.fetch(k) < SATURATION) { // past it the count no longer matters, and cannot wrap
+                            it.add(k, w);
+                        }
+                    };
+                    // offsets that land in the tile are within [x0 - v, x0 - v + TILE), give or take the
+                    // rounding of v + offset as in the gather kernel, which spans at most ROWS cells
+                    constexpr double eps = 1.0 / 1024;
+                    constexpr size_t ROWS = TILE + 2;
+                    size_t const e0 = first[g];
+                    size_t const n = (first[g+1] - e0) * ROWS;
+                    for (size_t j = l; j < n; j += TT) {
+                        auto const& v = vtx[entries[e0 + j / ROWS]];
+                        auto const p = v.position * zoom;
+                        auto const ky = static_cast<int32_t>(std::floor(y0 - p[1] - eps)) + R + static_cast<int32_t>(j % ROWS);
+                        if (ky < 0 || 2*R <= ky || std::floor(y0 + TILE - p[1] + eps) + R < ky) {
+                            continue;
+                        }
+                        auto const kx0 = std::max(static_cast<int32_t>(std::floor(x0 - p[0] - eps)) + R, 0);
+                        auto const kx1 = std::min(static_cast<int32_t>(std::floor(x0 + TILE - p[0] + eps)) + R, 2*R - 1);
+                        if (kx1 < kx0) {
+                            continue;
+                        }
+                        auto times = std::min(v.weight, SATURATION); // a heavier vertex would saturate anyway
+                        for (auto s = cfirst[ky * 2*R + kx0]; s < cfirst[ky * 2*R + kx1 + 1]; ++s) {
+                            auto i = csamples[s];
+                            if (i < s0 || s1 <= i) {
+                                continue;
+                            }
+                            auto pt = p + tbl[i].offset;
+                            size_t x = pt[0];
+                            size_t y = pt[1];
+                            if (0 < x && x - ox < cx && 0 < y && y - oy < cy && x - x0 < TILE && y - y0 < TILE) {
+                                auto w = tbl[i].weight;
+                                auto k = (y - y0) * TILE + (x - x0);
+                                add(0*TT + k, w[2] * times);
+                                add(1*TT + k, w[1] * times);
+                                add(2*TT + k, w[0] * times);
+                            }
+                        }
+                    }
+                }
+                else {
+                    size_t x = x0 + l % TILE - ox;
+                    size_t y = y0 + l / TILE - oy;
+                    if (x < cx && y < cy) {
+                        acc[y*cx + x] = Format::add(acc[y*cx + x], it[0*TT + l], it[1*TT + l], it[2*TT + l]);
+                    }
+                }
+            });
+        }
+        this->dev.wait(); // the host bins go away at the end of this scope
+    }
+
+    // The tonemap pass packs into the shm mapping directly when the device can reach host memory,
+    // otherwise into a device plane of which only the damaged rows are copied out.
+    template <class Pixel>
+    void tonemap(damage_region::rect rect, typename Pixel::value_type* pixels) {
+        using pixel_type = typename Pixel::value_type;
+        auto [x0, y0, x1, y1] = rect;
+        if (rect.empty()) {
+            return;
+        }
+        if (this->tone_format != Pixel::format) {
+            std::vector<uint16_t> curves;
+            for (auto bits : Pixel::depth) {
+                auto curve = tone_curve(bits, this->tone_gain);
+                curves.insert(curves.end(), curve.begin(), curve.end());
+            }
+            this->tones.assign(curves);
+            this->dev.wait(); // the host curves go away at the end of this scope
+            this->tone_format = Pixel::format;
+        }
+        if (this->direct == false) {
+            this->frame_pixels.resize(this->cx*this->cy); // words, wide enough for any format
+        }
+        auto pix = this->direct ? pixels : reinterpret_cast<pixel_type*>(this->frame_pixels.data());
+        auto acc = this->counts.data();
+        auto lut = this->tones.data();
+        size_t const cx = this->cx;
+        size_t const ox = x0;
+        size_t const oy = y0;
+        this->dev.for_each(y1 - y0, x1 - x0, [=](size_t row, size_t col) noexcept {
+            auto idx = (oy + row) * cx + ox + col;
+            auto [r, g, b] = Format::load(acc[idx]);
+            // one store of the whole pixel, so that a row vectorizes into table gathers
+            pix[idx] = Pixel::pack(lut, static_cast<uint32_t>(r), static_cast<uint32_t>(g), static_cast<uint32_t>(b));
+        });
+        if (this->direct == false) {
+            // whole rows, so that the damaged band is one contiguous copy
+            this->dev.memcpy(pixels + oy*cx, pix + oy*cx, (y1 - y0) * cx * sizeof (pixel_type));
+        }
+        this->dev.wait();
+    }
+
+private:
+    aux::device& dev;
+    size_t cx = 0;
+    size_t cy = 0;
+    size_t ox = 0;
+    size_t oy = 0;
+    aux::device_vector<value_type> counts;
+
+    // per-frame uploads, reused from frame to frame
+    aux::device_vector<weighted_vertex> fresh_vertices;
+    aux::device_vector<uint32_t> bin_tiles;
+    aux::device_vector<uint32_t> bin_first;
+    aux::device_vector<uint32_t> bin_entries;
+
+    // the tone curves of the pixel format last packed into
+    uint32_t tone_format = ~0u;
+    float tone_gain = 1;
+    aux::device_vector<uint16_t> tones;
+
+    bool direct;
+    aux::device_vector<uint32_t> frame_pixels;
+};
+
+using any_canvas = std::variant<canvas<packed_rgb>, canvas<float_rgb<float>>, canvas<float_rgb<aux::half>>>;
+
+inline any_canvas make_canvas(std::string_view format, aux::device& dev, size_t cx, size_t cy) {
+    if (format == packed_rgb::name)             return any_canvas{std::in_place_index<0>, dev, cx, cy};
+    if (format == float_rgb<float>::name)       return any_canvas{std::in_place_index<1>, dev, cx, cy};
+    if (format == float_rgb<aux::half>::name)   return any_canvas{std::in_place_index<2>, dev, cx, cy};
+    throw std::runtime_error("unknown accumulator format...");
+}
+
+/////////////////////////////////////////////////////////////////////////////
+#include <unordered_map>
+
+// Every vertex drawn since the last clear, kept to re-splat the canvas from scratch. Samples that
+// fall into the same 1/subdivision pixel cell merge into one weighted vertex at the first sample's
+// position, so a resting pen costs one vertex, not thousands. The store grows in fixed chunks that
+// are mirrored on the device, and only what changed since the last re-splat is uploaded.
+class vertex_store {
+public:
+    static constexpr size_t CHUNK = size_t{1} << 16;
+
+    // 0 subdivisions keeps every sample apart
+    vertex_store(aux::device& dev, uint32_t subdivision)
+        : dev{dev}
+        , subdivision{subdivision}
+        {
+        }
+
+    size_t size() const noexcept { return this->host.size(); }
+    size_t samples() const noexcept { return this->total; }
+    std::span<weighted_vertex const> vertices() const noexcept { return this->host; }
+
+    void clear() {
+        this->host.clear();
+        this->cells.clear();
+        this->dirty.clear();
+        this->total = 0;
+    }
+
+    // Adds the samples; `delta` receives, merged per cell, the weight they added to the store,
+    // which is what an incremental splat has to add to the canvas.
+    void append(std::span<aux::vec2d const> positions, std::vector<weighted_vertex>& delta) {
+        delta.clear();
+        std::unordered_map<size_t, size_t> touched; // store index -> delta index
+        for (auto const& position : positions) {
+            auto index = this->host.size();
+            if (this->subdivision) {
+                auto [it, added] = this->cells.try_emplace(this->cell_of(position), index);
+                index = it->second;
+                if (added == false) {
+                    ++this->host[index].weight;
+                    this->mark(index);
+                }
+            }
+            if (index == this->host.size()) {
+                this->host.push_back({ position, 1 });
+                this->mark(index);
+            }
+            auto [it, added] = touched.try_emplace(index, delta.size());
+            if (added) {
+                delta.push_back({ this->host[index].position, 0 });
+            }
+            ++delta[it->second].weight;
+            ++this->total;
+        }
+    }
+
+    // Uploads what changed and calls f(host chunk, device chunk) for every chunk.
+    template <class F>
+    void for_each_chunk(F&& f) {
+        for (size_t c = 0; c * CHUNK < this->host.size(); ++c) {
+            auto chunk = std::span{this->host}.subspan(c * CHUNK, std::min(CHUNK, this->host.size() - c * CHUNK));
+            if (this->chunks.size() <= c) {
+                this->chunks.emplace_back(this->dev).resize(CHUNK);
+            }
+            if (auto [lo, hi] = this->dirty[c]; lo < hi) {
+                this->chunks[c].write(lo, chunk.subspan(lo, hi - lo));
+                this->dirty[c] = { CHUNK, 0 };
+            }
+            f(std::span<weighted_vertex const>{chunk}, this->chunks[c].data());
+        }
+    }
+
+private:
+    size_t cell_of(aux::vec2d const& position) const noexcept {
+        auto q = [this](double p) noexcept {
+            return static_cast<uint32_t>(static_cast<int32_t>(std::floor(p * this->subdivision)));
+        };
+        return size_t{q(position[0])} << 32 | q(position[1]);
+    }
+    void mark(size_t index) {
+        auto c = index / CHUNK;
+        auto i = index % CHUNK;
+        if (this->dirty.size() <= c) {
+            this->dirty.resize(c + 1, { CHUNK, 0 });
+        }
+        auto& [lo, hi] = this->dirty[c];
+        lo = std::min(lo, i);
+        hi = std::max(hi, i + 1);
+    }
+
+private:
+    aux::device& dev;
+    uint32_t subdivision;
+    std::vector<weighted_vertex> host;
+    std::unordered_map<size_t, size_t> cells; // cell -> index in host
+    std::vector<std::pair<size_t, size_t>> dirty; // per chunk, the range changed since its last upload
+    std::vector<aux::device_vector<weighted_vertex>> chunks;
+    size_t total = 0;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+#include <fstream>
+#include <zlib.h>
+
+// An image file of xrgb8888 rows written top to bottom in bands, as raw words or as an 8-bit RGB
+// PNG deflated as the bands come, so that no more than a band is ever held.
+class poster_file {
+public:
+    poster_file(poster_file const&) = delete;
+    poster_file& operator=(poster_file const&) = delete;
+
+    poster_file(std::string_view path, size_t cx, size_t cy)
+        : out{std::string(path), std::ios::binary | std::ios::trunc}
+        , png{path.ends_with(".png")}
+        , cx{cx}
+        {
+            if (this->out.is_open() == false) {
+                throw std::runtime_error("failed to create the poster file...");
+            }
+            if (this->png) {
+                if (cx > std::numeric_limits<int32_t>::max() || cy > std::numeric_limits<int32_t>::max()) {
+                    throw std::runtime_error("too large for a PNG...");
+                }
+                if (::deflateInit(&this->stream, Z_DEFAULT_COMPRESSION) != Z_OK) {
+                    throw std::runtime_error("deflateInit failed...");
+                }
+                static constexpr char SIGNATURE[] = "\x89PNG\r\n\x1a\n";
+                this->out.write(SIGNATURE, 8);
+                std::array<uint8_t, 13> ihdr{};
+                put_be32(ihdr.data(), cx);
+                put_be32(ihdr.data() + 4, cy);
+                ihdr[8] = 8; // bits per channel
+                ihdr[9] = 2; // RGB, no palette, no alpha
+                this->chunk("IHDR", ihdr);
+                this->row.resize(1 + 3 * cx);
+                this->idat.resize(IDAT);
+                this->stream.next_out = this->idat.data();
+                this->stream.avail_out = this->idat.size();
+            }
+        }
+    ~poster_file() noexcept {
+        if (this->png) {
+            ::deflateEnd(&this->stream);
+        }
+    }
+
+    // `rows` whole rows of cx pixels
+    void write(uint32_t const* pixels, size_t rows) {
+        if (this->png == false) {
+            this->out.write(reinterpret_cast<char const*>(pixels), rows * this->cx * sizeof (uint32_t));
+            return;
+        }
+        for (size_t y = 0; y < rows; ++y, pixels += this->cx) {
+            // the Sub filter: every byte less the same channel of the pixel before
+            this->row[0] = 1;
+            uint8_t prev[3] = {};
+            for (size_t x = 0; x < this->cx; ++x) {
+                uint8_t const rgb[3] = {
+                    static_cast<uint8_t>(pixels[x] >> 16),
+                    static_cast<uint8_t>(pixels[x] >> 8),
+                    static_cast<uint8_t>(pixels[x]),
+                };
+                for (size_t c = 0; c < 3; ++c) {
+                    this->row[1 + 3*x + c] = rgb[c] - prev[c];
+                    prev[c] = rgb[c];
+                }
+            }
+            this->deflate(this->row.data(), this->row.size(), Z_NO_FLUSH);
+        }
+    }
+
+    // Completes the file; a poster not finished is cut short.
+    void finish() {
+        if (this->png) {
+            this->deflate(nullptr, 0, Z_FINISH);
+            this->chunk("IEND", {});
+        }
+        this->out.flush();
+        if (this->out.good() == false) {
+            throw std::runtime_error("failed to write the poster...");
+        }
+    }
+
+private:
+    static constexpr size_t IDAT = size_t{1} << 18; // bytes of deflated data per IDAT chunk
+
+    static void put_be32(uint8_t* at, uint32_t value) noexcept {
+        at[0] = value >> 24;
+        at[1] = value >> 16;
+        at[2] = value >> 8;
+        at[3] = value;
+    }
+    void chunk(char const (&type)[5], std::span<uint8_t const> data) {
+        uint8_t head[8];
+        put_be32(head, data.size());
+        std::memcpy(head + 4, type, 4);
+        auto crc = ::crc32(0, head + 4, 4);
+        if (data.empty() == false) {
+            crc = ::crc32(crc, data.data(), data.size()); // which would restart for a null pointer
+        }
+        uint8_t tail[4];
+        put_be32(tail, crc);
+        this->out.write(reinterpret_cast<char const*>(head), sizeof head);
+        this->out.write(reinterpret_cast<char const*>(data.data()), data.size());
+        this->out.write(reinterpret_cast<char const*>(tail), sizeof tail);
+    }
+    void deflate(uint8_t const* data, size_t bytes, int flush) {
+        this->stream.next_in = const_cast<uint8_t*>(data);
+        this->stream.avail_in = bytes;
+        for (;;) {
+            auto status = ::deflate(&this->stream, flush);
+            if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR) {
+                throw std::runtime_error("deflate failed...");
+            }
+            bool const done = flush == Z_FINISH ? status == Z_STREAM_END : this->stream.avail_in == 0;
+            if (this->stream.avail_out == 0 || (done && flush == Z_FINISH)) {
+                this->chunk("IDAT", std::span{this->idat}.first(this->idat.size() - this->stream.avail_out));
+                this->stream.next_out = this->idat.data();
+                this->stream.avail_out = this->idat.size();
+            }
+            if (done) {
+                return;
+            }
+        }
+    }
+
+private:
+    std::ofstream out;
+    bool png;
+    size_t cx;
+    z_stream stream{};
+    std::vector<uint8_t> row;  // filter type and RGB bytes of one PNG row
+    std::vector<uint8_t> idat; // deflated bytes not yet written
+};
+
+// The size of a poster of the strokes of a canvas: cx x cy or, where either is 0, as large as the
+// other makes it at the canvas' aspect, POSTER_SCALE times the canvas if both are.
+struct poster_geometry {
+    static constexpr double POSTER_SCALE = 4;
+
+    size_t cx;
+    size_t cy;
+    double scale; // poster pixels per canvas pixel
+
+    static poster_geometry fit(size_t canvas_cx, size_t canvas_cy, size_t cx, size_t cy) noexcept {
+        double const scale = cx ? static_cast<double>(cx) / canvas_cx
+                           : cy ? static_cast<double>(cy) / canvas_cy
+                           : POSTER_SCALE;
+        return {
+            cx ? cx : static_cast<size_t>(std::lround(canvas_cx * scale)),
+            cy ? cy : static_cast<size_t>(std::lround(canvas_cy * scale)),
+            scale,
+        };
+    }
+};
+
+// Renders the vertices onto a poster of any size, out of core: the poster is cut into bands of
+// tiles up to POSTER_TILE wide and together holding POSTER_TILE^2 pixels, each tile is splatted
+// on one reused tile canvas with only the vertices whose spiral reaches it, and every band goes
+// to the file as soon as its tiles are done. The spiral grows with the scale and the tones are
+// exposed for it as in the window (see spiral), so a poster looks like a sharper window.
+inline void export_poster(aux::device& dev, std::string_view accumulator, std::span<weighted_vertex const> vertices,
+                          uint32_t N, double D, poster_geometry const& poster, std::string_view path) {
+    static constexpr size_t POSTER_TILE = 2048;
+    auto const [px, py, scale] = poster;
+    auto const tx = std::min(px, POSTER_TILE);
+    auto const ty = std::clamp<size_t>(POSTER_TILE * POSTER_TILE / px, 1, std::min(py, POSTER_TILE));
+
+    auto canvas = make_canvas(accumulator, dev, tx, ty);
+    auto sp = spiral{dev};
+    sp.assign(N, D, scale);
+    std::visit([&](auto& canvas) { canvas.expose(scale * scale); }, canvas);
+
+    // the vertices in poster pixels, ordered by row so that a band finds its own in one range
+    aux::versor_array<double, 2> at;
+    at.assign(vertices, &weighted_vertex::position);
+    at *= scale;
+    std::vector<uint32_t> order(vertices.size());
+    std::iota(order.begin(), order.end(), 0);
+    auto const ys = at.component(1);
+    auto const xs = at.component(0);
+    std::ranges::sort(order, std::less<>(), [&](uint32_t v) { return ys[v]; });
+
+    poster_file file{path, px, py};
+    std::vector<uint32_t> band(px * ty);
+    std::vector<uint32_t> tile(tx * ty);
+    std::vector<weighted_vertex> reaching;
+    for (size_t oy = 0; oy < py; oy += ty) {
+        auto const rows = std::min(ty, py - oy);
+        auto below = [&](double y) noexcept {
+            return std::ranges::partition_point(order, [&](uint32_t v) { return ys[v] < y; });
+        };
+        auto const candidates = std::ranges::subrange(below(oy - sp.reach), below(oy + rows + sp.reach));
+        for (size_t ox = 0; ox < px; ox += tx) {
+            auto const cols = std::min(tx, px - ox);
+            reaching.clear();
+            for (auto v : candidates) {
+                if (ox - sp.reach <= xs[v] && xs[v] < ox + cols + sp.reach) {
+                    reaching.push_back(vertices[v]);
+                }
+            }
+            std::visit([&](auto& canvas) {
+                canvas.move_to(ox, oy);
+                canvas.clear();
+                canvas.splat(sp, reaching);
+                canvas.template tonemap<xrgb8888>({ 0, 0, static_cast<int32_t>(cols), static_cast<int32_t>(rows) }, tile.data());
+            }, canvas);
+            for (size_t row = 0; row < rows; ++row) {
+                std::copy_n(tile.data() + row * tx, cols, band.data() + row * px + ox);
+            }
+        }
+        file.write(band.data(), rows);
+    }
+    file.finish();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+#include <ostream>
+#include <iomanip>
+
+// Per-stage frame timing: the host wall time of each stage and the device time it caused, kept
+// for the last WINDOW runs of the stage so that p50 and p99 follow the recent frames. `latency`
+// is no stage but the time from an input event to the presentation of the frame showing it.
+enum class stage { clear, splat, tonemap, commit, dispatch, latency };
+inline constexpr std::array<std::string_view, 6> stage_names = { "clear", "splat", "tonemap", "commit", "dispatch", "latency" };
+
+class stage_profile {
+public:
+    static constexpr size_t WINDOW = 512;
+
+    void record(stage s, double host_ms, double device_ms) noexcept {
+        auto& series = this->stages[static_cast<size_t>(s)];
+        series.host[series.count % WINDOW] = host_ms;
+        series.device[series.count % WINDOW] = device_ms;
+        ++series.count;
+    }
+
+    // Runs f() as stage s. Device work issued before is settled first and the stage's own is waited
+    // for, so that both clocks cover the stage alone; with profiling off busy_ms() reports 0 and
+    // waits for nothing.
+    template <class F>
+    void time(aux::device& dev, stage s, F&& f) {
+        dev.busy_ms();
+        auto t0 = std::chrono::steady_clock::now();
+        f();
+        auto device_ms = dev.busy_ms();
+        std::chrono::duration<double, std::milli> host = std::chrono::steady_clock::now() - t0;
+        this->record(s, host.count(), device_ms);
+    }
+
+    struct summary {
+        size_t runs = 0; // in total, not only in the window
+        double host_p50 = 0;
+        double host_p99 = 0;
+        double device_p50 = 0;
+        double device_p99 = 0;
+    };
+    summary summarize(stage s) const {
+        auto const& series = this->stages[static_cast<size_t>(s)];
+        auto n = std::min(series.count, WINDOW);
+        auto percentile = [n](std::array<float, WINDOW> const& window, double p) {
+            if (n == 0) {
+                return 0.0;
+            }
+            std::array<float, WINDOW> sorted = window;
+            auto k = std::min(static_cast<size_t>(p * n), n - 1);
+            std::nth_element(sorted.begin(), sorted.begin() + k, sorted.begin() + n);
+            return static_cast<double>(sorted[k]);
+        };
+        return {
+            series.count,
+            percentile(series.host, 0.50),
+            percentile(series.host, 0.99),
+            percentile(series.device, 0.50),
+            percentile(series.device, 0.99),
+        };
+    }
+
+    // One JSON object on one line, stages that never ran left out.
+    void write_json(std::ostream& out, double seconds, size_t frames) const {
+        auto flags = out.flags();
+        out << std::fixed << std::setprecision(4);
+        out << "{\"t\":" << seconds << ",\"frames\":" << frames;
+        for (size_t i = 0; i < stage_names.size(); ++i) {
+            auto sum = this->summarize(static_cast<stage>(i));
+            if (sum.runs) {
+                out << ",\"" << stage_names[i] << "\":{\"runs\":" << sum.runs
+                    << ",\"host_p50\":" << sum.host_p50 << ",\"host_p99\":" << sum.host_p99
+                    << ",\"device_p50\":" << sum.device_p50 << ",\"device_p99\":" << sum.device_p99 << '}';
+            }
+        }
+        out << '}' << std::endl;
+        out.flags(flags);
+    }
+
+private:
+    struct series {
+        std::array<float, WINDOW> host{};
+        std::array<float, WINDOW> device{};
+        size_t count = 0;
+    };
+    std::array<series, stage_names.size()> stages;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+#include <atomic>
+#include <mutex>
+#include <bit>
+
+// What an input device reported between two of its frame events.
+struct input_sample {
+    aux::vec2d position;   // buffer pixels
+    float pressure = 1;    // [0, 1], 1 for devices that cannot tell
+    aux::vec2f tilt = {};  // degrees
+    uint32_t time = 0;     // ms
+};
+
+// Single-producer single-consumer ring: the dispatch thread pushes, the render thread drains,
+// neither of them ever blocks or allocates.
+template <class T, size_t N>
+class spsc_ring {
+    static_assert(std::has_single_bit(N));
+
+public:
+    // from the producer side
+    bool empty() const noexcept {
+        return this->head.load(std::memory_order_relaxed) == this->tail.load(std::memory_order_acquire);
+    }
+    // false when full, the sample is lost then
+    bool push(T const& value) noexcept {
+        auto head = this->head.load(std::memory_order_relaxed);
+        if (head - this->tail.load(std::memory_order_acquire) == N) {
+            return false;
+        }
+        this->items[head % N] = value;
+        this->head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+    // appends everything pushed so far to `out`
+    void drain(std::vector<T>& out) {
+        auto tail = this->tail.load(std::memory_order_relaxed);
+        auto head = this->head.load(std::memory_order_acquire);
+        for (; tail != head; ++tail) {
+            out.push_back(this->items[tail % N]);
+        }
+        this->tail.store(tail, std::memory_order_release);
+    }
+
+private:
+    alignas(64) std::atomic<size_t> head = 0;
+    alignas(64) std::atomic<size_t> tail = 0;
+    std::array<T, N> items;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+
+// One record of a stroke journal: an input sample as it was submitted, a scroll that changed the
+// spiral, an ESC that dropped the strokes, or the window size the sample positions refer to.
+struct journal_event {
+    enum class kind : uint8_t { end, sample, params, clear, resize };
+    kind type = kind::end;
+    input_sample sample;
+    uint32_t N = 0;
+    uint32_t M = 0;
+    double D = 0;
+    uint32_t cx = 0; // buffer pixels
+    uint32_t cy = 0;
+};
+
+// The file layout shared by stroke_journal and journal_reader: a header, then records that start
+// with the tag() of their kind, native byte order. A sample of a delta journal is PACKED when it lies on
+// the 1/256 px grid of wl_fixed: its time and position are then varints of the difference to
+// the previous sample, followed by pressure and tilt only if they changed (EXTRA).
+namespace journal_format
+{
+    inline constexpr char MAGIC[8] = "othjrnl";
+    inline constexpr uint32_t VERSION = 1;
+    inline constexpr uint32_t DELTA = 1;   // header flag
+    inline constexpr uint8_t KIND = 0x0f;  // tag bits
+    inline constexpr uint8_t PACKED = 0x10;
+    inline constexpr uint8_t EXTRA = 0x20;
+    inline constexpr double GRID = 256;
+
+    constexpr uint8_t tag(journal_event::kind k) noexcept { return static_cast<uint8_t>(k); }
+
+    struct header {
+        char magic[8];
+        uint32_t version;
+        uint32_t flags;
+    };
+
+    inline uint64_t zigzag(int64_t v) noexcept { return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63); }
+    inline int64_t unzigzag(uint64_t v) noexcept { return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1); }
+}
+
+// Appends journal_events to a file through a shared mapping that grows geometrically, from the
+// Wayland dispatch thread as the events happen. The file is only trimmed to what was written when
+// the journal is destroyed; the zero tail a crashed session leaves reads as an end record. The
+// records are called from listeners that must not throw: a journal that cannot grow says so once
+// and records nothing more.
+class stroke_journal {
+public:
+    stroke_journal(stroke_journal const&) = delete;
+    stroke_journal& operator=(stroke_journal const&) = delete;
+
+    stroke_journal(std::string_view path, bool delta)
+        : fd{::open(std::string(path).c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)}
+        , delta{delta}
+        {
+            if (this->fd < 0 || this->reserve(INITIAL) == false) {
+                throw std::runtime_error("failed to create the stroke journal...");
+            }
+            this->put(journal_format::header{ {}, journal_format::VERSION, delta ? journal_format::DELTA : 0 });
+            std::memcpy(this->data, journal_format::MAGIC, sizeof journal_format::MAGIC);
+        }
+    ~stroke_journal() noexcept {
+        if (this->data) {
+            ::munmap(this->data, this->capacity);
+            [[maybe_unused]] auto trimmed = ::ftruncate(this->fd, this->used);
+        }
+    }
+
+    void sample(input_sample const& s) noexcept {
+        using namespace journal_format;
+        if (this->reserve(this->used + MAX_RECORD) == false) {
+            return;
+        }
+        auto& last = this->last;
+        int64_t const qx = std::llround((s.position[0] - last.position[0]) * GRID);
+        int64_t const qy = std::llround((s.position[1] - last.position[1]) * GRID);
+        bool const packed = this->delta
+            && last.position[0] + qx / GRID == s.position[0]
+            && last.position[1] + qy / GRID == s.position[1];
+        if (packed) {
+            bool const extra = s.pressure != last.pressure || s.tilt != last.tilt;
+            this->put<uint8_t>(tag(journal_event::kind::sample) | PACKED | (extra ? EXTRA : 0));
+            this->put_varint(static_cast<uint32_t>(s.time - last.time));
+            this->put_varint(zigzag(qx));
+            this->put_varint(zigzag(qy));
+            if (extra) {
+                this->put(s.pressure);
+                this->put(s.tilt);
+            }
+        }
+        else {
+            this->put(tag(journal_event::kind::sample));
+            this->put(s.time);
+            this->put(s.position);
+            this->put(s.pressure);
+            this->put(s.tilt);
+        }
+        last = s;
+    }
+    void params(uint32_t N, uint32_t M, double D) noexcept {
+        if (this->reserve(this->used + MAX_RECORD)) {
+            this->put(journal_format::tag(journal_event::kind::params));
+            this->put(N);
+            this->put(M);
+            this->put(D);
+        }
+    }
+    void clear() noexcept {
+        if (this->reserve(this->used + MAX_RECORD)) {
+            this->put(journal_format::tag(journal_event::kind::clear));
+        }
+    }
+    void resize(size_t cx, size_t cy) noexcept {
+        if (this->reserve(this->used + MAX_RECORD)) {
+            this->put(journal_format::tag(journal_event::kind::resize));
+            this->put(static_cast<uint32_t>(cx));
+            this->put(static_cast<uint32_t>(cy));
+        }
+    }
+
+private:
+    static constexpr size_t INITIAL = size_t{1} << 20;
+    static constexpr size_t MAX_RECORD = 64;
+
+    bool reserve(size_t bytes) noexcept {
+        if (bytes <= this->capacity) {
+            return true;
+        }
+        if (this->failed) {
+            return false;
+        }
+        auto size = std::max(bytes, 2 * this->capacity);
+        void* data = MAP_FAILED;
+        if (::ftruncate(this->fd, size) == 0) {
+            data = this->data
+                ? ::mremap(this->data, this->capacity, size, MREMAP_MAYMOVE)
+                : ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, 0);
+        }
+        if (data == MAP_FAILED) {
+            std::cerr << "the stroke journal cannot grow past " << this->capacity << " bytes, recording stopped" << std::endl;
+            this->failed = true;
+            return false;
+        }
+        this->data = static_cast<std::byte*>(data);
+        this->capacity = size;
+        return true;
+    }
+    template <class T>
+    void put(T const& value) noexcept {
+        std::memcpy(this->data + this->used, &value, sizeof value);
+        this->used += sizeof value;
+    }
+    void put_varint(uint64_t value) noexcept {
+        for (; value >= 0x80; value >>= 7) {
+            this->put<uint8_t>(value | 0x80);
+        }
+        this->put<uint8_t>(value);
+    }
+
+private:
+    aux::unique_fd fd;
+    bool delta;
+    bool failed = false;
+    std::byte* data = nullptr;
+    size_t capacity = 0;
+    size_t used = 0;
+    input_sample last; // the previous sample, what packed samples are relative to
+};
+
+// Reads a stroke journal back, mapped read-only, one event at a time.
+class journal_reader {
+public:
+    journal_reader(journal_reader const&) = delete;
+    journal_reader& operator=(journal_reader const&) = delete;
+
+    explicit journal_reader(std::string_view path) {
+        auto fd = aux::unique_fd{::open(std::string(path).c_str(), O_RDONLY | O_CLOEXEC)};
+        struct stat st;
+        if (fd < 0 || ::fstat(fd, &st) < 0) {
+            throw std::runtime_error("failed to open the stroke journal...");
+        }
+        this->size = st.st_size;
+        journal_format::header header{};
+        if (this->size >= sizeof header) {
+            void* data = ::mmap(nullptr, this->size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                throw std::runtime_error("mmap failed...");
+            }
+            this->data = static_cast<std::byte const*>(data);
+            std::memcpy(&header, this->data, sizeof header);
+        }
+        if (std::memcmp(header.magic, journal_format::MAGIC, sizeof header.magic) || header.version != journal_format::VERSION) {
+            throw std::runtime_error("not a stroke journal...");
+        }
+        this->rewind();
+    }
+    ~journal_reader() noexcept {
+        if (this->data) {
+            ::munmap(const_cast<std::byte*>(this->data), this->size);
+        }
+    }
+
+    void rewind() noexcept {
+        this->cursor = sizeof (journal_format::header);
+        this->last = {};
+        this->read();
+    }
+    // The window size the first sample was taken at, `cx` x `cy` if the journal does not tell.
+    std::pair<size_t, size_t> first_size(size_t cx, size_t cy) noexcept {
+        for (this->rewind(); this->current.type != journal_event::kind::end && this->current.type != journal_event::kind::sample; this->pop()) {
+            if (this->current.type == journal_event::kind::resize) {
+                cx = this->current.cx;
+                cy = this->current.cy;
+            }
+        }
+        this->rewind();
+        return { cx, cy };
+    }
+
+    // the current event, of kind::end past the last one
+    journal_event const& peek() const noexcept { return this->current; }
+    void pop() noexcept { this->read(); }
+
+private:
+    // Decodes the event at the cursor; a record cut short reads as the end.
+    void read() noexcept {
+        using namespace journal_format;
+        auto& e = this->current;
+        e = {};
+        uint8_t bits = 0;
+        if (this->get(bits) == false) {
+            return;
+        }
+        bool ok = true;
+        auto const type = static_cast<journal_event::kind>(bits & KIND);
+        switch (type) {
+        case journal_event::kind::sample:
+            e.sample = this->last;
+            if (bits & PACKED) {
+                uint64_t dt = 0, qx = 0, qy = 0;
+                ok = this->get_varint(dt) && this->get_varint(qx) && this->get_varint(qy);
+                e.sample.time += static_cast<uint32_t>(dt);
+                e.sample.position[0] += unzigzag(qx) / GRID;
+                e.sample.position[1] += unzigzag(qy) / GRID;
+                if (bits & EXTRA) {
+                    ok = ok && this->get(e.sample.pressure) && this->get(e.sample.tilt);
+                }
+            }
+            else {
+                ok = this->get(e.sample.time) && this->get(e.sample.position) && this->get(e.sample.pressure) && this->get(e.sample.tilt);
+            }
+            this->last = e.sample;
+            break;
+        case journal_event::kind::params:
+            ok = this->get(e.N) && this->get(e.M) && this->get(e.D);
+            break;
+        case journal_event::kind::clear:
+            break;
+        case journal_event::kind::resize:
+            ok = this->get(e.cx) && this->get(e.cy);
+            break;
+        default:
+            ok = false; // the zero tail of an unfinished journal, or garbage
+            break;
+        }
+        if (ok) {
+            e.type = type;
+        }
+        else {
+            e = {};
+            this->cursor = this->size;
+        }
+    }
+    template <class T>
+    bool get(T& value) noexcept {
+        if (this->size - this->cursor < sizeof value) {
+            return false;
+        }
+        std::memcpy(&value, this->data + this->cursor, sizeof value);
+        this->cursor += sizeof value;
+        return true;
+    }
+    bool get_varint(uint64_t& value) noexcept {
+        value = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            uint8_t byte;
+            if (this->get(byte) == false) {
+                return false;
+            }
+            value |= uint64_t{byte & 0x7fu} << shift;
+            if ((byte & 0x80) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    std::byte const* data = nullptr;
+    size_t size = 0;
+    size_t cursor = 0;
+    input_sample last;
+    journal_event current;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+#include <chrono>
+#include <random>
+#include <fstream>
+#include <iomanip>
+
+struct options {
+    std::string_view backend = "auto";   // "auto", "gpu", "cpu" or "native", see aux::device::select()
+    std::string_view accumulator = packed_rgb::name;
+    std::string_view format = "auto";    // shm pixel format, see make_pixel()
+    bool headless = false;
+    size_t frames = 600;
+    size_t cx = 1920;
+    size_t cy = 1080;
+    size_t rate = 16;                 // vertices appended per headless frame
+    std::string_view stream = "walk"; // "walk", or a file of whitespace separated x y pairs
+    std::string_view output;          // file the headless framebuffer is mapped onto, raw pixels in --format
+    uint32_t compact = 16;            // samples within 1/compact px merge into one vertex, 0 keeps them all
+    std::string_view hugepages = "transparent"; // "none", "transparent" or "explicit", see aux::shm_arena
+    double budget = 0;                // ms a frame may take to render before the resolution drops, 0 keeps it full
+    double refine = 8;                // ms a frame's splat may take while large N are refined over frames, 0 splats all at once
+    std::string_view profile;         // file stage timings are appended to as JSON lines every second, "-" for stdout
+    bool overlay = false;             // draw the stage timings over the frame
+    std::string_view journal;         // file the input of a Wayland session is recorded to, see stroke_journal
+    bool journal_delta = true;        // delta-compress the journal's samples
+    std::string_view replay;          // stroke journal fed to the headless stages instead of --stream
+    bool realtime = false;            // replay at the journal's own pace instead of as fast as possible
+    std::string_view poster;          // .png or raw xrgb8888 file the strokes are exported to, on P or after a headless run
+    size_t poster_cx = 0;             // poster size, see poster_geometry::fit()
+    size_t poster_cy = 0;
+    uint32_t N = 233;
+    double D = 2.0;
+
+    static options parse(int argc, char** argv) {
+        options opt;
+        for (int i = 1; i < argc; ++i) {
+            std::string_view arg = argv[i];
+            auto value = [&] {
+                if (i+1 < argc) {
+                    return argv[++i];
+                }
+                throw std::runtime_error("missing option value...");
+            };
+            if      (arg == "--backend")     opt.backend = value();
+            else if (arg == "--accumulator") opt.accumulator = value();
+            else if (arg == "--format")      opt.format = value();
+            else if (arg == "--headless")    opt.headless = true;
+            else if (arg == "--frames")      opt.frames = std::strtoul(value(), nullptr, 10);
+            else if (arg == "--rate")        opt.rate = std::strtoul(value(), nullptr, 10);
+            else if (arg == "--stream")      opt.stream = value();
+            else if (arg == "--output")      opt.output = value();
+            else if (arg == "--compact")     opt.compact = std::strtoul(value(), nullptr, 10);
+            else if (arg == "--hugepages")   opt.hugepages = value();
+            else if (arg == "--budget")      opt.budget = std::strtod(value(), nullptr);
+            else if (arg == "--refine")      opt.refine = std::strtod(value(), nullptr);
+            else if (arg == "--profile")     opt.profile = value();
+            else if (arg == "--overlay")     opt.overlay = true;
+            else if (arg == "--journal")     opt.journal = value();
+            else if (arg == "--journal-raw") opt.journal_delta = false;
+            else if (arg == "--replay")      opt.replay = value(), opt.headless = true;
+            else if (arg == "--realtime")    opt.realtime = true;
+            else if (arg == "-N")            opt.N = std::strtoul(value(), nullptr, 10);
+            else if (arg == "-D")            opt.D = std::strtod(value(), nullptr);
+            else if (arg == "--poster")      opt.poster = value();
+            else if (arg == "--poster-size") {
+                auto size = value();
+                if (std::sscanf(size, "%zux%zu", &opt.poster_cx, &opt.poster_cy) < 1 && std::sscanf(size, "x%zu", &opt.poster_cy) != 1) {
+                    throw std::runtime_error("--poster-size expects WIDTHxHEIGHT, WIDTH or xHEIGHT...");
+                }
+            }
+            else if (arg == "--size") {
+                if (std::sscanf(value(), "%zux%zu", &opt.cx, &opt.cy) != 2) {
+                    throw std::runtime_error("--size expects WIDTHxHEIGHT...");
+                }
+            }
+            else {
+                throw std::runtime_error("unknown option...");
+            }
+        }
+        return opt;
+    }
+};
+
+// Synthetic input for headless runs: a seeded random walk, or recorded strokes replayed in a loop.
+class vertex_stream {
+public:
+    vertex_stream(std::string_view source, size_t cx, size_t cy)
+        : cx{static_cast<double>(cx)}
+        , cy{static_cast<double>(cy)}
+        , position{cx / 2.0, cy / 2.0}
+        {
+            if (source != "walk") {
+                std::ifstream input{std::string(source)};
+                for (double x, y; input >> x >> y; ) {
+                    this->recorded.emplace_back(x, y);
+                }
+                if (this->recorded.empty()) {
+                    throw std::runtime_error("no vertices recorded in the stream...");
+                }
+            }
+        }
+
+    void next(std::vector<aux::vec2d>& vertices, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            if (this->recorded.empty() == false) {
+                vertices.push_back(this->recorded[this->cursor++ % this->recorded.size()]);
+                continue;
+            }
+            // a pen-like stroke: constant speed, slowly wandering heading, bouncing off the edges
+            this->heading += std::normal_distribution<double>(0.0, 0.25)(this->rng);
+            auto step = std::polar(2.0, this->heading);
+            auto& [x, y] = this->position;
+            x += step.real();
+            y += step.imag();
+            if (x < 0 || this->cx <= x) { x = std::clamp(x, 0.0, this->cx - 1); this->heading = std::numbers::pi - this->heading; }
+            if (y < 0 || this->cy <= y) { y = std::clamp(y, 0.0, this->cy - 1); this->heading = -this->heading; }
+            vertices.push_back(this->position);
+        }
+    }
+
+private:
+    double cx;
+    double cy;
+    aux::vec2d position;
+    double heading = 0;
+    std::mt19937 rng{5489u};
+    std::vector<aux::vec2d> recorded;
+    size_t cursor = 0;
+};
+
+// Where --profile sends its JSON lines; `file` is opened for it unless that is stdout.
+inline std::ostream& profile_log(options const& opt, std::ofstream& file) {
+    if (opt.profile == "-") {
+        return std::cout;
+    }
+    file.open(std::string(opt.profile), std::ios::app);
+    if (file.is_open() == false) {
+        throw std::runtime_error("failed to open the profile log...");
+    }
+    return file;
+}
+
+// The clear/splat/tonemap stages of the Wayland loop against a plain framebuffer, in memory or
+// mapped onto --output, fed by a vertex_stream or a --replay journal; prints the frame rate and
+// the stage times.
+inline int headless(options const& opt) {
+    using namespace aux;
+    std::optional<journal_reader> journal;
+    if (opt.replay.empty() == false) {
+        journal.emplace(opt.replay);
+    }
+    auto const size = journal ? journal->first_size(opt.cx, opt.cy) : std::pair{opt.cx, opt.cy};
+    auto const cx = size.first;
+    auto const cy = size.second;
+
+    auto dev = device::select(opt.backend, true);
+    std::cout << dev.name() << std::endl;
+    auto canvas = make_canvas(opt.accumulator, dev, cx, cy);
+    auto sp = spiral{dev};
+    sp.assign(opt.N, opt.D);
+    auto const pixel = make_pixel(opt.format);
+    size_t const bytes = cx*cy * std::visit([](auto pixel) { return sizeof (typename decltype (pixel)::value_type); }, pixel);
+
+    std::vector<uint32_t> memory; // words, wide enough for any format
+    unique_fd fd;
+    void* pixels = nullptr;
+    if (opt.output.empty()) {
+        memory.resize(cx*cy);
+        pixels = memory.data();
+    }
+    else {
+        fd = unique_fd{::open(std::string(opt.output).c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)};
+        if (fd < 0 || ::ftruncate(fd, bytes) < 0) {
+            throw std::runtime_error("failed to create the output file...");
+        }
+        pixels = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (pixels == MAP_FAILED) {
+            throw std::runtime_error("mmap failed...");
+        }
+    }
+
+    using clock = std::chrono::steady_clock;
+    stage_profile profile;
+    std::ofstream profile_file;
+    auto log = opt.profile.empty() ? nullptr : &profile_log(opt, profile_file);
+    auto reported = clock::now();
+
+    vertex_stream stream{opt.stream, cx, cy};
+    vertex_store store{dev, opt.compact};
+    std::vector<vec2d> vertices;
+    std::vector<weighted_vertex> delta;
+    auto t0 = clock::now();
+
+    // A replay frame takes FRAME_MS of the session, all that was journaled in it at once, and the
+    // replay runs until the journal ends; with --realtime a frame first waits for its time to come.
+    // Resizes after the first sample are not followed, the positions keep their canvas pixels.
+    static constexpr double FRAME_MS = 1000.0 / 60;
+    std::optional<uint32_t> first_time; // of the session's first sample
+    size_t replayed = 0;
+    auto replay = [&](size_t frame) {
+        bool resplat = false; // the spiral changed or the strokes were dropped
+        auto const until = (frame + 1) * FRAME_MS;
+        if (opt.realtime) {
+            std::this_thread::sleep_until(t0 + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double, std::milli>(until)));
+        }
+        for (;; journal->pop()) {
+            auto const& e = journal->peek();
+            if (e.type == journal_event::kind::end) {
+                break;
+            }
+            if (e.type == journal_event::kind::sample) {
+                first_time = first_time.value_or(e.sample.time);
+                if (static_cast<int32_t>(e.sample.time - *first_time) >= until) {
+                    break;
+                }
+                vertices.push_back(e.sample.position);
+                ++replayed;
+            }
+            else if (e.type == journal_event::kind::params) {
+                sp.assign(e.N, e.D);
+                resplat = true;
+            }
+            else if (e.type == journal_event::kind::clear) {
+                vertices.clear();
+                store.clear();
+                resplat = true;
+            }
+        }
+        return resplat;
+    };
+
+    size_t frame = 0;
+    for (; journal ? journal->peek().type != journal_event::kind::end : frame < opt.frames; ++frame) {
+        std::visit([&](auto& canvas, auto pixel) {
+            using pixel_type = typename decltype (pixel)::value_type;
+            damage_region damage;
+            vertices.clear();
+            bool resplat = false;
+            if (journal) {
+                resplat = replay(frame);
+            }
+            else {
+                stream.next(vertices, opt.rate);
+            }
+            store.append(vertices, delta);
+            if (frame == 0 || resplat) {
+                profile.time(dev, stage::clear, [&] { canvas.clear(); });
+                damage.add({ 0, 0, static_cast<int32_t>(cx), static_cast<int32_t>(cy) });
+            }
+            if (resplat) {
+                profile.time(dev, stage::splat, [&] {
+                    store.for_each_chunk([&](auto host, auto resident) { canvas.splat(sp, host, resident); });
+                });
+            }
+            else {
+                for (auto const& v : delta) {
+                    damage.add(reach_bounds(v.position * sp.zoom, sp.reach, cx, cy));
+                }
+                profile.time(dev, stage::splat, [&] { canvas.splat(sp, delta); });
+            }
+            profile.time(dev, stage::tonemap, [&] { canvas.template tonemap<decltype (pixel)>(damage.bounds(), static_cast<pixel_type*>(pixels)); });
+        }, canvas, pixel);
+        if (log && clock::now() - reported >= std::chrono::seconds(1)) {
+            reported = clock::now();
+            profile.write_json(*log, std::chrono::duration<double>(reported - t0).count(), frame + 1);
+        }
+    }
+    std::chrono::duration<double> elapsed = clock::now() - t0;
+
+    std::cout << "headless " << cx << 'x' << cy << ' ' << opt.accumulator << ' ' << std::visit([](auto pixel) { return pixel.name; }, pixel) << ", ";
+    if (journal) {
+        std::cout << frame << " frames replaying " << replayed << " samples of " << opt.replay;
+    }
+    else {
+        std::cout << frame << " frames of " << opt.rate << " vertices, N=" << opt.N << " D=" << opt.D;
+    }
+    std::cout << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "fps     " << frame / elapsed.count() << std::endl;
+    std::cout << "ms      host p50/p99     device p50/p99" << std::endl;
+    for (auto s : { stage::clear, stage::splat, stage::tonemap }) {
+        auto sum = profile.summarize(s);
+        std::cout << std::left << std::setw(8) << stage_names[static_cast<size_t>(s)]
+                  << sum.host_p50 << " / " << sum.host_p99 << "    " << sum.device_p50 << " / " << sum.device_p99 << std::endl;
+    }
+    if (log) {
+        profile.write_json(*log, elapsed.count(), frame);
+    }
+    std::cout << "store   " << store.size() << " vertices for " << store.samples() << " samples" << std::endl;
+    if (opt.poster.empty() == false) {
+        auto const poster = poster_geometry::fit(cx, cy, opt.poster_cx, opt.poster_cy);
+        auto const t = clock::now();
+        export_poster(dev, opt.accumulator, store.vertices(), sp.N, sp.D, poster, opt.poster);
+        std::cout << "poster  " << poster.cx << 'x' << poster.cy << " in " << std::chrono::duration<double>(clock::now() - t).count() << " s" << std::endl;
+    }
+    if (opt.output.empty() == false) {
+        ::munmap(pixels, bytes);
+    }
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// The Wayland client. bench.cc includes this file without it, see OTHONES_NO_MAIN there.
+#ifndef OTHONES_NO_MAIN
+#include <set>
+#include <map>
+#include <list>
+#include <sstream>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include <cairo/cairo.h>
+#include <linux/input-event-codes.h>
+
+// The cairo format that draws into an shm buffer of the given format in place.
+constexpr cairo_format_t cairo_format(wl_shm_format format) noexcept {
+    switch (format) {
+    case WL_SHM_FORMAT_ARGB8888:    return CAIRO_FORMAT_ARGB32;
+    case WL_SHM_FORMAT_XRGB8888:    return CAIRO_FORMAT_RGB24;
+    case WL_SHM_FORMAT_RGB565:      return CAIRO_FORMAT_RGB16_565;
+    case WL_SHM_FORMAT_XRGB2101010: return CAIRO_FORMAT_RGB30;
+    default:                        return CAIRO_FORMAT_INVALID;
+    }
+}
+
+int main(int argc, char** argv) {
+    using namespace aux;
+    auto const opt = options::parse(argc, argv);
+    if (opt.headless) {
+        return headless(opt);
+    }
+
+    auto display = wrapper{wl_display_connect(nullptr)};
+    auto registry = wrapper{wl_display_get_registry(display)};
+
+    wrapper<wl_compositor> compositor;
+    wrapper<wl_shm> shm;
+    std::set<uint32_t> shm_formats;
+
+    wrapper<wl_seat> seat;
+    wrapper<wl_pointer> pointer;
+    wrapper<wl_keyboard> keyboard;
+    wrapper<wl_touch> touch;
+    bool quit = false;
+
+    wrapper<xdg_wm_base> shell;
+    wrapper<wp_viewporter> viewporter;
+    wrapper<wp_presentation> presentation;
+    clockid_t presentation_clock = -1;
 
     size_t scale = 2; // possible maximum scale, would be adjust to the smallest output...
     size_t cx = 1920;
@@ -461,11 +2876,39 @@ int main(int, char** argv) {
     std::vector<wrapper<wl_output>> outputs;
 
     uint32_t M = 144;
-    uint32_t N = 233;
-    double D = 2.0;
+    uint32_t N = opt.N;
+    double D = opt.D;
     wl_surface* pointer_surface = nullptr;
     vec2d pointer_current = {};
-    std::vector<vec2d> vertices;
+
+    // Input goes to the render thread through the ring, one sample per device frame, and is never
+    // held back by a render in progress. Everything else is collected here until the next render job.
+    spsc_ring<input_sample, 4096> samples;
+    std::optional<stroke_journal> journal; // what the session did, to --replay it headless later
+    if (opt.journal.empty() == false) {
+        journal.emplace(opt.journal, opt.journal_delta);
+        journal->params(N, M, D);
+    }
+    auto submit = [&](input_sample const& sample) {
+        samples.push(sample); // a full ring means the render thread has stalled for seconds
+        if (journal) {
+            journal->sample(sample);
+        }
+    };
+    struct {
+        bool configured = false; // the first configure has been acked, buffers may be attached
+        bool resized = true;     // the buffers and channels must follow cx x cy
+        bool cleared = false;    // the strokes so far are dropped
+        bool retabulate = true;  // the spiral table must be rebuilt for N and D
+        bool poster = false;     // the strokes are to be exported to --poster
+    } pending;
+    std::optional<input_sample> pointer_pending;   // the press of this pointer frame
+    std::vector<input_sample> touch_pending;       // the moved touch points of this touch frame
+    struct tool_state {
+        input_sample sample; // pressure and tilt are only sent when they change
+        bool moved = false;
+    };
+    std::map<zwp_tablet_tool_v2*, tool_state> tools;
 
     wrapper<zwp_tablet_manager_v2>        tablet_mgr;
     wrapper<zwp_tablet_seat_v2>           tablet_seat;
@@ -477,6 +2920,9 @@ int main(int, char** argv) {
         }
         else if (interface == interface_ptr<wl_shm>->name) {
             shm = wrapper{registry_bind<wl_shm>(registry, name, version)};
+            shm->format = lamed([&](auto, auto, uint32_t format) noexcept {
+                shm_formats.insert(format);
+            });
         }
         else if (interface == interface_ptr<wl_seat>->name) {
             seat = wrapper{registry_bind<wl_seat>(registry, name, version)};
@@ -487,7 +2933,13 @@ int main(int, char** argv) {
                         if (s == WL_KEYBOARD_KEY_STATE_RELEASED) {
                             switch (k) {
                             case KEY_ESC:
-                                vertices.clear();
+                                pending.cleared = true;
+                                if (journal) {
+                                    journal->clear();
+                                }
+                                break;
+                            case KEY_P:
+                                pending.poster = opt.poster.empty() == false;
                                 break;
                             }
                         }
@@ -524,6 +2976,10 @@ int main(int, char** argv) {
                                 M = std::max<uint32_t>(tmp - M, 1);
                             }
                             std::cout << N << std::endl;
+                            pending.retabulate = true;
+                            if (journal) {
+                                journal->params(N, M, D);
+                            }
                         }
                         if (axis == WL_POINTER_AXIS_VERTICAL_SCROLL) {
                             if (value < 0) {
@@ -533,14 +2989,24 @@ int main(int, char** argv) {
                                 D /= 1.1;
                             }
                             std::cout << D << std::endl;
+                            pending.retabulate = true;
+                            if (journal) {
+                                journal->params(N, M, D);
+                            }
                         }
 
                     });
                 }
                 if (capabilities & WL_SEAT_CAPABILITY_TOUCH) {
                     touch = wrapper{wl_seat_get_touch(seat)};
-                    touch->motion = lamed([&](auto, auto, auto, auto, auto x, auto y) {
-                        vertices.emplace_back(scale*wl_fixed_to_double(x), scale*wl_fixed_to_double(y));
+                    touch->motion = lamed([&](auto, auto, uint32_t time, auto, auto x, auto y) {
+                        touch_pending.push_back({ { scale*wl_fixed_to_double(x), scale*wl_fixed_to_double(y) }, 1, {}, time });
+                    });
+                    touch->frame = lamed([&](auto...) noexcept {
+                        for (auto const& sample : touch_pending) {
+                            submit(sample);
+                        }
+                        touch_pending.clear();
                     });
                 }
             });
@@ -551,6 +3017,15 @@ int main(int, char** argv) {
                 xdg_wm_base_pong(shell, serial);
             };
         }
+        else if (interface == interface_ptr<wp_viewporter>->name) {
+            viewporter = wrapper{registry_bind<wp_viewporter>(registry, name, version)};
+        }
+        else if (interface == interface_ptr<wp_presentation>->name) {
+            presentation = wrapper{registry_bind<wp_presentation>(registry, name, version)};
+            presentation->clock_id = lamed([&](auto, auto, uint32_t clock) noexcept {
+                presentation_clock = clock;
+            });
+        }
         else if (interface == interface_ptr<wl_output>->name) {
             outputs.emplace_back(wrapper{registry_bind<wl_output>(registry, name, version)});
             outputs.back()->mode = lamed([&](auto, auto, auto, int32_t width, int32_t height, auto) noexcept {
@@ -572,6 +3047,7 @@ int main(int, char** argv) {
                 std::cout << "Tool added: " << std::endl;
                 tool->removed = lamed([&](auto, auto t) {
                     std::cout << "Tool removed: " << std::endl;
+                    tools.erase(t);
                     tablet_tools.erase(t);
                 });
                 tool->type = [](auto, auto, auto type) {
@@ -588,15 +3064,14 @@ int main(int, char** argv) {
                     switch (capability) {
                     case ZWP_TABLET_TOOL_V2_CAPABILITY_TILT:
                         std::cout << ", Tilt supported.";
-                        tool->tilt = lamed([&](auto, auto, auto x, auto y) {
-                            //vertices.back().position -= vec2d{wl  _fixed_to_double(x), wl_fixed_to_double(y)};
-                            //vertices.back().pressure += std::sqrt(x*x + y*y);
+                        tool->tilt = lamed([&](auto, auto t, auto x, auto y) {
+                            tools[t].sample.tilt = { wl_fixed_to_double(x), wl_fixed_to_double(y) };
                         });
                         break;
                     case ZWP_TABLET_TOOL_V2_CAPABILITY_PRESSURE:
                         std::cout << ", Pressure supported.";
-                        tool->pressure = lamed([&](auto, auto, auto pressure) {
-                            //vertices.back().pressure += pressure;
+                        tool->pressure = lamed([&](auto, auto t, uint32_t pressure) {
+                            tools[t].sample.pressure = pressure / 65535.0f;
                         });
                         break;
                     case ZWP_TABLET_TOOL_V2_CAPABILITY_DISTANCE:
@@ -617,14 +3092,18 @@ int main(int, char** argv) {
                 tool->button = [](auto, auto, auto serial, auto button, auto state) {
                     std::cout << "^^^ " << std::tuple{serial, button, state} << std::endl;
                 };
-                tool->motion = lamed([&](auto, auto, auto x, auto y) {
-                    //vertices.back().position += vec2d{wl_fixed_to_double(x), wl_fixed_to_double(y)};
-                    vertices.emplace_back(scale*wl_fixed_to_double(x), scale*wl_fixed_to_double(y));
+                tool->motion = lamed([&](auto, auto t, auto x, auto y) {
+                    auto& state = tools[t];
+                    state.sample.position = { scale*wl_fixed_to_double(x), scale*wl_fixed_to_double(y) };
+                    state.moved = true;
                 });
-                tool->frame = lamed([&](auto, auto, auto) {
-                    // if (vertices.back().pressure > 0) {
-                    //     vertices.push_back({});
-                    // }
+                tool->frame = lamed([&](auto, auto t, uint32_t time) {
+                    // motion, pressure and tilt of one report come in one frame, the time only with the frame
+                    auto& state = tools[t];
+                    if (std::exchange(state.moved, false)) {
+                        state.sample.time = time;
+                        submit(state.sample);
+                    }
                 });
             });
         }
@@ -633,35 +3112,45 @@ int main(int, char** argv) {
     wl_display_roundtrip(display);
 
     auto surface = wrapper{wl_compositor_create_surface(compositor)};
-    wl_surface_set_buffer_scale(surface, scale);
+    // with a frame budget the buffers are sized by the render resolution and the compositor scales
+    // them to the window through a viewport, otherwise they are the window at the output scale.
+    wrapper<wp_viewport> viewport;
+    if (opt.budget > 0 && viewporter) {
+        viewport = wrapper{wp_viewporter_get_viewport(viewporter, surface)};
+    }
+    else {
+        if (opt.budget > 0) {
+            std::cout << "no wp_viewporter, rendering at full resolution" << std::endl;
+        }
+        wl_surface_set_buffer_scale(surface, scale);
+    }
     auto xsurface = wrapper{xdg_wm_base_get_xdg_surface(shell, surface)};
-    xsurface->configure = [](auto, auto xsurface, auto serial) noexcept {
+    xsurface->configure = lamed([&](auto, auto xsurface, auto serial) noexcept {
         xdg_surface_ack_configure(xsurface, serial);
-    };
+        pending.configured = true;
+    });
 
-    auto que = sycl::queue();
-    std::cout << que.get_device().get_info<sycl::info::device::name>() << std::endl;
-    std::cout << que.get_device().get_info<sycl::info::device::vendor>() << std::endl;
-    auto channels = [&] {
-        auto deleter = [&](auto ptr) { sycl::free(ptr, que); };
-        using unique_type = std::unique_ptr<double, decltype (deleter)>;
-        return std::array<unique_type, 4> {
-            unique_type{ sycl::malloc_device<double>(cx*cy, que), deleter },
-            unique_type{ sycl::malloc_device<double>(cx*cy, que), deleter },
-            unique_type{ sycl::malloc_device<double>(cx*cy, que), deleter },
-            unique_type{ sycl::malloc_device<double>(cx*cy, que), deleter },
-        };
-    }();
+    bool const profiling = opt.profile.empty() == false || opt.overlay;
+    auto dev = device::select(opt.backend, profiling);
+    std::cout << dev.name() << std::endl;
+    auto canvas = make_canvas(opt.accumulator, dev, cx, cy);
+    auto sp = spiral{dev};
+    auto const pixel = make_pixel(opt.format, std::vector<uint32_t>(shm_formats.begin(), shm_formats.end()));
+    std::visit([&](auto pixel) {
+        if (shm_formats.contains(pixel.format) == false) {
+            throw std::runtime_error("pixel format not supported by the compositor...");
+        }
+    }, pixel);
 
-    auto [fd, buffer, pixels] = shm_allocate_buffer(shm, cx, cy);
     auto toplevel = wrapper{xdg_surface_get_toplevel(xsurface)};
     toplevel->configure = lamed([&](auto, auto, auto w, auto h, auto) {
-        cx = scale*w;
-        cy = scale*h;
-        if (cx * cy) {
-            std::tie(fd, buffer, pixels) = shm_allocate_buffer(shm, cx, cy);
-            for (auto& channel : channels) {
-                channel.reset(sycl::malloc_device<double>(cx*cy, que));
+        // a configure that keeps the size, as focus and state changes send, reuses the buffers as they are.
+        if (w * h && (cx != static_cast<size_t>(scale*w) || cy != static_cast<size_t>(scale*h))) {
+            cx = scale*w;
+            cy = scale*h;
+            pending.resized = true;
+            if (journal) {
+                journal->resize(cx, cy);
             }
         }
     });
@@ -669,12 +3158,18 @@ int main(int, char** argv) {
         quit = true;
     });
     xdg_toplevel_set_app_id(toplevel, std::filesystem::path(argv[0]).filename().c_str());
+    if (journal) {
+        journal->resize(cx, cy); // as the outputs left it, configure records what follows
+    }
     if (pointer) {
-        pointer->button = lamed([&](auto, auto, auto serial, auto, auto button, auto state) noexcept {
+        pointer->button = lamed([&](auto, auto pointer, auto serial, uint32_t time, auto button, auto state) noexcept {
             if (state == WL_POINTER_BUTTON_STATE_PRESSED) {
                 switch (button) {
                 case BTN_LEFT:
-                    vertices.emplace_back(pointer_current);
+                    pointer_pending = input_sample{ pointer_current, 1, {}, time };
+                    if (wl_pointer_get_version(pointer) < WL_POINTER_FRAME_SINCE_VERSION) {
+                        submit(*std::exchange(pointer_pending, std::nullopt));
+                    }
                     break;
                 case BTN_RIGHT:
                     xdg_toplevel_show_window_menu(toplevel, seat, serial,
@@ -684,83 +3179,524 @@ int main(int, char** argv) {
                 }
             }
         });
+        pointer->frame = lamed([&](auto...) noexcept {
+            if (pointer_pending) {
+                submit(*std::exchange(pointer_pending, std::nullopt));
+            }
+        });
     }
 
-    wl_surface_commit(surface);
+    // a small pool of buffers, one of them is rendered while the compositor may still read the others.
+    struct frame_buffer {
+        wrapper<wl_buffer> buffer;
+        void* pixels = nullptr; // of the value_type of the selected pixel format
+        bool busy = false; // attached and not released by the compositor yet
+        damage_region::rect stale; // pixels changed on the canvas since this buffer was last drawn
+        size_t offset = 0; // of the pixels in the arena
+        size_t bytes = 0;
+    };
+    std::array<frame_buffer, 3> buffers;
+    // A buffer still busy when the buffers are reallocated is kept, with its pixels, until the
+    // compositor releases it, since it may read them until then.
+    struct retired_buffer {
+        wrapper<wl_buffer> buffer;
+        size_t offset = 0;
+        size_t bytes = 0;
+        bool released = false;
+    };
+    std::list<retired_buffer> retired;
+
+    // Adaptive resolution: the canvas and buffers are cx x cy scaled by `zoom`, which drops while the
+    // smoothed render time of drawn frames is over --budget and creeps back up in steps while it is
+    // well under; the pixel work of a frame goes with zoom^2, so a step up cannot overshoot at once.
+    static constexpr double ZOOM_STEP = 1.0 / 16;
+    static constexpr double ZOOM_MIN = 1.0 / 4;
+    static constexpr size_t SETTLE = 30; // frames measured at a zoom before it is judged
+    double zoom = 1;
+    struct {
+        double mean = 0; // ms, exponentially smoothed
+        size_t frames = 0;
+    } render_time;
+    auto render_size = [&] {
+        return std::pair{
+            std::max<size_t>(std::lround(cx * zoom), 1),
+            std::max<size_t>(std::lround(cy * zoom), 1),
+        };
+    };
+    auto adapt = [&](double ms) {
+        render_time.mean = render_time.frames ? 0.9 * render_time.mean + 0.1 * ms : ms;
+        if (++render_time.frames < SETTLE) {
+            return;
+        }
+        auto z = zoom;
+        if (render_time.mean > opt.budget) {
+            z = std::min(std::floor(zoom * std::sqrt(opt.budget / render_time.mean) / ZOOM_STEP) * ZOOM_STEP, zoom - ZOOM_STEP);
+        }
+        else if (render_time.mean < opt.budget / 2) {
+            z = zoom + ZOOM_STEP;
+        }
+        z = std::clamp(z, ZOOM_MIN, 1.0);
+        if (z != zoom) {
+            zoom = z;
+            render_time = {};
+            pending.resized = true;
+            pending.retabulate = true;
+        }
+    };
 
-    while (wl_display_dispatch(display) != -1) {
-        if (quit) {
-            break;
+    auto arena = shm_arena{shm, opt.hugepages};
+    auto allocate_buffers = [&] {
+        auto [rx, ry] = render_size();
+        std::erase_if(retired, [](auto const& r) { return r.released; });
+        for (auto& fb : buffers) {
+            if (fb.busy) {
+                retired.push_back({ std::move(fb.buffer), fb.offset, fb.bytes }); // with its release handler below
+            }
+        }
+        // laid out back to back in the arena, which keeps the largest size seen so shrinking is free:
+        // from its start, or past the retired buffers when that would overlap one of them.
+        std::visit([&](auto pixel) {
+            using pixel_type = typename decltype (pixel)::value_type;
+            auto const bytes = sizeof (pixel_type) * rx*ry;
+            auto const size = bytes * buffers.size();
+            bool overlapped = false;
+            size_t past = 0;
+            for (auto const& r : retired) {
+                overlapped = overlapped || r.offset < size;
+                past = std::max(past, (r.offset + r.bytes + 63) / 64 * 64);
+            }
+            auto const offset = overlapped ? past : 0;
+            arena.reserve(offset + size);
+            for (size_t i = 0; i < buffers.size(); ++i) {
+                buffers[i].offset = offset + i * bytes;
+                buffers[i].bytes = bytes;
+                std::tie(buffers[i].buffer, buffers[i].pixels) = arena.create_buffer<pixel_type, decltype (pixel)::format>(buffers[i].offset, rx, ry);
+            }
+        }, pixel);
+        if (viewport) {
+            wp_viewport_set_destination(viewport, cx / scale, cy / scale); // applies with the next buffer
         }
-        if (cx * cy) {
-            static constexpr double TAU = 2.0 * std::numbers::pi;
-            static constexpr double PSI = 1.0 / std::numbers::phi;
+        for (auto& fb : buffers) {
+            fb.busy = false; // the busy ones were retired above, their replacements start free
+            fb.stale = { 0, 0, static_cast<int32_t>(rx), static_cast<int32_t>(ry) };
+            fb.buffer->release = lamed([&](auto, auto released) noexcept {
+                for (auto& fb : buffers) {
+                    if (fb.buffer == released) {
+                        fb.busy = false;
+                    }
+                }
+                for (auto& r : retired) {
+                    if (r.buffer == released) {
+                        r.released = true;
+                    }
+                }
+            });
+        }
+    };
+    bool frame_pending = false; // the compositor has not asked for the next frame yet
+    wrapper<wl_callback> frame;
+
+    // Stage timings: the render thread records its stages, the main thread the others and reads
+    // them all while the render thread is idle. Only the render thread may ask the device.
+    stage_profile profile;
+    std::ofstream profile_file;
+    auto log = opt.profile.empty() ? nullptr : &profile_log(opt, profile_file);
+    auto const started = std::chrono::steady_clock::now();
+    auto reported = started;
+    size_t presented = 0;
+    auto host_ms = [](auto t0) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    };
 
-            auto buffer_ch = std::tuple{
-                sycl::buffer<double, 2>{channels[0].get(), {cy, cx}},
-                sycl::buffer<double, 2>{channels[1].get(), {cy, cx}},
-                sycl::buffer<double, 2>{channels[2].get(), {cy, cx}},
-                sycl::buffer<double, 2>{channels[3].get(), {cy, cx}},
+    // --overlay: p50/p99 of every stage over the top left of the frame; the covered pixels are
+    // marked stale, so the canvas comes back underneath the next time the buffer is drawn.
+    // Returns the rectangle drawn over.
+    auto draw_overlay = [&](frame_buffer& fb) {
+        auto [rx, ry] = render_size();
+        double const em = 12.0 * (viewport ? scale * zoom : scale);
+        auto const w = std::min<int32_t>(std::lround(em * 30), rx);
+        auto const h = std::min<int32_t>(std::lround(em * 1.25 * (stage_names.size() + 1) + em / 2), ry);
+        return std::visit([&](auto pixel) -> damage_region::rect {
+            size_t const stride = sizeof (typename decltype (pixel)::value_type) * rx;
+            if (stride % 4) {
+                return {}; // cairo needs 4-byte aligned rows, which an odd width in RGB565 does not have
+            }
+            auto surf = cairo_image_surface_create_for_data(static_cast<unsigned char*>(fb.pixels),
+                                                            cairo_format(decltype (pixel)::format), w, h, stride);
+            auto cr = cairo_create(surf);
+            cairo_set_source_rgba(cr, 0, 0, 0, 0.6);
+            cairo_rectangle(cr, 0, 0, w, h);
+            cairo_fill(cr);
+            cairo_select_font_face(cr, "monospace", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+            cairo_set_font_size(cr, em);
+            cairo_set_source_rgb(cr, 1, 1, 1);
+            auto line = [&, y = 0.0](std::string const& text) mutable {
+                cairo_move_to(cr, em / 2, y += em * 1.25);
+                cairo_show_text(cr, text.c_str());
             };
-            auto buffer_px = sycl::buffer<color, 2>{pixels, {cy, cx}};
-            que.submit([&](auto& h) noexcept {
-                auto ach = std::get<0>(buffer_ch).template get_access<sycl::access::mode::write>(h);
-                auto rch = std::get<1>(buffer_ch).template get_access<sycl::access::mode::write>(h);
-                auto gch = std::get<2>(buffer_ch).template get_access<sycl::access::mode::write>(h);
-                auto bch = std::get<3>(buffer_ch).template get_access<sycl::access::mode::write>(h);
-                auto pix = buffer_px.template get_access<sycl::access::mode::write>(h);
-                h.parallel_for({cy, cx}, [=](auto idx) noexcept {
-                    pix[idx] = { };
-                    ach[idx] = { };
-                    rch[idx] = { };
-                    gch[idx] = { };
-                    bch[idx] = { };
-                });
-            });
-            if (vertices.empty() == false) {
-                auto buffer_vtx = sycl::buffer<vec2d, 1>{vertices.data(), vertices.size()};
-                que.submit([&](auto& h) noexcept {
-                    auto ach = std::get<0>(buffer_ch).template get_access<sycl::access::mode::write>(h);
-                    auto rch = std::get<1>(buffer_ch).template get_access<sycl::access::mode::write>(h);
-                    auto gch = std::get<2>(buffer_ch).template get_access<sycl::access::mode::write>(h);
-                    auto bch = std::get<3>(buffer_ch).template get_access<sycl::access::mode::write>(h);
-                    auto vtx = buffer_vtx.get_access<sycl::access::mode::read>(h);
-                    h.parallel_for({vertices.size()}, [=](auto idx) noexcept {
-                        for (uint32_t i = 0; i < N; ++i) {
-                            auto theta = std::polar(sqrt(1+i)/D, (1+i) * TAU * PSI);
-                            auto pt = vtx[idx] + vec2d{theta.real(), theta.imag()};
-                            size_t x = pt[0];
-                            size_t y = pt[1];
-                            if (0 < x && x < cx && 0 < y && y < cy) {
-                                double d = 1.0 - static_cast<double>(i+1)/N;
-                                ach[{y, x}] += 255; // d/4;
-                                rch[{y, x}] += hue(d*1530)[2]/1;
-                                gch[{y, x}] += hue(d*1530)[1]/1;
-                                bch[{y, x}] += hue(d*1530)[0]/1;
-                            }
-                        }
+            line("ms        host p50/p99   device p50/p99");
+            for (size_t i = 0; i < stage_names.size(); ++i) {
+                auto sum = profile.summarize(static_cast<stage>(i));
+                std::ostringstream text;
+                text << std::left << std::setw(10) << stage_names[i] << std::right << std::fixed << std::setprecision(2)
+                     << std::setw(6) << sum.host_p50 << std::setw(7) << sum.host_p99
+                     << std::setw(10) << sum.device_p50 << std::setw(7) << sum.device_p99;
+                line(text.str());
+            }
+            cairo_destroy(cr);
+            cairo_surface_flush(surf);
+            cairo_surface_destroy(surf);
+            damage_region::rect const rect = { 0, 0, w, h };
+            fb.stale = fb.stale | rect;
+            return rect;
+        }, pixel);
+    };
+
+    // The render thread owns the canvas and does one job at a time: it takes the new samples and
+    // the job's changes, splats, and tonemaps into the target if there is one. The main thread only
+    // fills in a job while the render thread is idle, and learns of its completion from `finished`.
+    struct {
+        size_t cx = 0;
+        size_t cy = 0;
+        bool resized = false;
+        bool cleared = false;
+        std::optional<std::pair<uint32_t, double>> retabulate;
+        std::optional<poster_geometry> poster;
+        double zoom = 1;
+        frame_buffer* target = nullptr; // null: splat only, no buffer may be drawn into now
+        double elapsed = 0;             // ms the render thread spent, 0 when it re-splatted or refined everything
+        bool refining = false;          // not all N spiral samples are in the channels yet
+        std::vector<uint32_t> inputs;   // event times of the samples splatted since the last drawn frame
+        damage_region damage;           // accumulated over jobs until the next commit
+    } job;
+    enum class worker_state { idle, busy, quit };
+    std::atomic<worker_state> worker = worker_state::idle;
+    auto finished = unique_fd{::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)};
+    auto renderer = std::thread([&] {
+        vertex_store store{dev, opt.compact};
+        std::vector<input_sample> batch;
+        std::vector<vec2d> positions;
+        std::vector<weighted_vertex> delta;
+        bool invalidated = true; // channels must be cleared and the whole store re-splatted
+        // Progressive refinement: after a re-splat the channels hold only the first `refined` spiral
+        // samples of every vertex, and each job adds the next `step` of them until all N are in.
+        // `step` follows the time the last one took towards --refine; new samples join the channels
+        // at the current refinement, the rest of theirs comes with the following steps.
+        static constexpr uint32_t REFINE_MIN = 16;
+        uint32_t refined = 0;
+        uint32_t step = REFINE_MIN;
+        // A poster is exported on a thread of its own, from a copy of the vertices and on a device
+        // of its own, so that drawing goes on however long it takes; one export at a time.
+        std::atomic<bool> exporting = false;
+        std::thread exporter;
+        for (;;) {
+            worker.wait(worker_state::idle, std::memory_order_acquire);
+            if (worker.load(std::memory_order_acquire) == worker_state::quit) {
+                break;
+            }
+            auto const t0 = std::chrono::steady_clock::now();
+            if (job.resized) {
+                std::visit([&](auto& canvas) {
+                    canvas.resize(job.cx, job.cy);
+                    canvas.expose(job.zoom * job.zoom);
+                }, canvas);
+                invalidated = true;
+            }
+            batch.clear();
+            samples.drain(batch);
+            if (job.cleared) {
+                store.clear();
+                batch.clear();
+                job.inputs.clear();
+                invalidated = true;
+            }
+            positions.clear();
+            for (auto const& sample : batch) {
+                positions.push_back(sample.position);
+                job.inputs.push_back(sample.time);
+            }
+            store.append(positions, delta);
+            if (job.retabulate) {
+                sp.assign(job.retabulate->first, job.retabulate->second, job.zoom);
+                invalidated = true;
+            }
+            bool const resplat = invalidated || refined < sp.N;
+            auto const cx = job.cx;
+            auto const cy = job.cy;
+            std::visit([&](auto& canvas, auto pixel) {
+                using pixel_type = typename decltype (pixel)::value_type;
+                damage_region damage;
+                if (std::exchange(invalidated, false)) {
+                    damage.add({ 0, 0, static_cast<int32_t>(cx), static_cast<int32_t>(cy) });
+                    profile.time(dev, stage::clear, [&] { canvas.clear(); });
+                    refined = 0;
+                }
+                else if (delta.empty() == false) {
+                    // only the weight this job added, the rest is already in the channels.
+                    for (auto const& v : delta) {
+                        damage.add(reach_bounds(v.position * sp.zoom, sp.reach, cx, cy));
+                    }
+                    profile.time(dev, stage::splat, [&] { canvas.splat(sp, delta, nullptr, 0, refined); });
+                }
+                if (refined < sp.N) {
+                    // the store already holds this job's samples, splat the next of theirs from its device chunks.
+                    auto const count = opt.refine > 0 ? std::min(step, sp.N - refined) : sp.N - refined;
+                    damage.add({ 0, 0, static_cast<int32_t>(cx), static_cast<int32_t>(cy) });
+                    auto const t1 = std::chrono::steady_clock::now();
+                    profile.time(dev, stage::splat, [&] {
+                        store.for_each_chunk([&](auto host, auto resident) { canvas.splat(sp, host, resident, refined, refined + count); });
                     });
-                });
+                    std::chrono::duration<double, std::milli> took = std::chrono::steady_clock::now() - t1;
+                    if (opt.refine > 0 && count == step && took.count() > 0) {
+                        // a step costs more the further out its samples are, so it grows no faster than twice
+                        step = static_cast<uint32_t>(std::clamp(step * opt.refine / took.count(), double{REFINE_MIN}, 2.0 * step));
+                    }
+                    refined += count;
+                }
+                // every buffer falls behind by this job's damage, the target catches up on all it missed.
+                for (auto& fb : buffers) {
+                    fb.stale = fb.stale | damage.bounds();
+                }
+                for (auto const& rect : damage) {
+                    job.damage.add(rect);
+                }
+                if (job.target) {
+                    profile.time(dev, stage::tonemap, [&] {
+                        canvas.template tonemap<decltype (pixel)>(std::exchange(job.target->stale, {}), static_cast<pixel_type*>(job.target->pixels));
+                    });
+                }
+            }, canvas, pixel);
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - t0;
+            job.elapsed = resplat ? 0 : elapsed.count();
+            job.refining = refined < sp.N;
+            if (job.poster && exporting.load(std::memory_order_acquire)) {
+                std::cerr << "a poster is still being exported..." << std::endl;
             }
-            que.submit([&](auto& h) noexcept {
-                auto ach = std::get<0>(buffer_ch).template get_access<sycl::access::mode::read>(h);
-                auto rch = std::get<1>(buffer_ch).template get_access<sycl::access::mode::read>(h);
-                auto gch = std::get<2>(buffer_ch).template get_access<sycl::access::mode::read>(h);
-                auto bch = std::get<3>(buffer_ch).template get_access<sycl::access::mode::read>(h);
-                auto pix = buffer_px.template get_access<sycl::access::mode::read_write>(h);
-                h.parallel_for({cy, cx}, [=](auto idx) noexcept {
-                    auto& p = pix[idx];
-                    p[3] = 255;
-                    p[2] = 255 - 255.0 / (rch[idx] + 1);
-                    p[1] = 255 - 255.0 / (gch[idx] + 1);
-                    p[0] = 255 - 255.0 / (bch[idx] + 1);
+            else if (job.poster) {
+                if (exporter.joinable()) {
+                    exporter.join();
+                }
+                exporting.store(true, std::memory_order_release);
+                auto vertices = std::vector<weighted_vertex>(store.vertices().begin(), store.vertices().end());
+                exporter = std::thread([&, vertices = std::move(vertices), N = sp.N, D = sp.D, poster = *job.poster] {
+                    // a failed export must not take the session with it
+                    try {
+                        auto dev = device::select(opt.backend);
+                        export_poster(dev, opt.accumulator, vertices, N, D, poster, opt.poster);
+                        std::cout << "poster " << poster.cx << 'x' << poster.cy << " written to " << opt.poster << std::endl;
+                    }
+                    catch (std::exception const& e) {
+                        std::cerr << e.what() << std::endl;
+                    }
+                    exporting.store(false, std::memory_order_release);
                 });
-            });
+            }
+            worker.store(worker_state::idle, std::memory_order_release);
+            worker.notify_one();
+            uint64_t const one = 1;
+            [[maybe_unused]] auto _ = ::write(finished, &one, sizeof one);
+        }
+        if (exporter.joinable()) {
+            exporter.join(); // an export under way is finished rather than left half written
+        }
+    });
+
+    // Hands the render thread a job when there is something new and it is idle. A full job needs the
+    // frame callback and a released buffer; without them the new samples are still splatted, after
+    // CATCH_UP, so that they neither pile up in the ring nor all land in the first frame shown again.
+    static constexpr itimerspec CATCH_UP = { {}, { 0, 100'000'000 } };
+    auto timer = unique_fd{::timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK)};
+    bool armed = false;
+    bool catch_up = false;
+    bool running = false; // kicked and not presented yet
+    auto schedule = [&] {
+        if (pending.configured == false || running) {
+            return;
+        }
+        if (!(job.resized || job.refining || pending.resized || pending.cleared || pending.retabulate || pending.poster || samples.empty() == false)) {
+            return;
+        }
+        if (std::exchange(pending.resized, false)) {
+            allocate_buffers();
+            job.resized = true;
+        }
+        auto target = std::ranges::find(buffers, false, &frame_buffer::busy);
+        bool const drawable = frame_pending == false && target != buffers.end();
+        if (drawable == false && std::exchange(catch_up, false) == false) {
+            if (std::exchange(armed, true) == false) {
+                ::timerfd_settime(timer, 0, &CATCH_UP, nullptr);
+            }
+            return;
+        }
+        if (std::exchange(armed, false)) {
+            static constexpr itimerspec DISARM = {};
+            ::timerfd_settime(timer, 0, &DISARM, nullptr);
         }
-        wl_surface_damage(surface, 0, 0, cx, cy);
-        wl_surface_attach(surface, buffer, 0, 0);
+        std::tie(job.cx, job.cy) = render_size();
+        job.zoom = zoom;
+        job.cleared = std::exchange(pending.cleared, false);
+        if (std::exchange(pending.poster, false)) {
+            job.poster = poster_geometry::fit(cx, cy, opt.poster_cx, opt.poster_cy);
+        }
+        if (std::exchange(pending.retabulate, false)) {
+            job.retabulate.emplace(N, D);
+        }
+        job.target = drawable ? &*target : nullptr;
+        running = true;
+        worker.store(worker_state::busy, std::memory_order_release);
+        worker.notify_one();
+    };
+    // Input-to-photon latency: every drawn frame asks for presentation feedback, which measures
+    // each sample it shows first from its event time. Those times are whole ms of CLOCK_MONOTONIC
+    // on the compositors around, so the clocks only compare when the presentation clock is that
+    // one, and the latency reads up to 1 ms long.
+    struct feedback_request {
+        wrapper<presentation_feedback> feedback;
+        std::vector<uint32_t> inputs;
+        bool done = false;
+    };
+    std::vector<feedback_request> feedbacks;
+    bool const measure_latency = profiling && presentation && presentation_clock == CLOCK_MONOTONIC;
+    if (profiling && measure_latency == false) {
+        std::cout << "no wp_presentation on CLOCK_MONOTONIC, input latency is not measured" << std::endl;
+    }
+    auto request_feedback = [&](std::vector<uint32_t> inputs) {
+        std::erase_if(feedbacks, [](auto const& request) { return request.done; });
+        auto& request = feedbacks.emplace_back(wrapper{wp_presentation_feedback(presentation, surface)}, std::move(inputs));
+        auto find = [&](presentation_feedback* feedback) -> feedback_request& {
+            return *std::ranges::find(feedbacks, feedback, [](auto const& request) -> presentation_feedback* { return request.feedback; });
+        };
+        request.feedback->presented = lamed([&, find](auto, auto feedback, uint32_t sec_hi, uint32_t sec_lo, uint32_t nsec, auto...) noexcept {
+            auto& request = find(feedback);
+            auto const sec = uint64_t{sec_hi} << 32 | sec_lo;
+            auto const ms = static_cast<uint32_t>(sec * 1000 + nsec / 1'000'000); // wraps like the event times
+            for (auto time : request.inputs) {
+                profile.record(stage::latency, static_cast<uint32_t>(ms - time) + (nsec % 1'000'000) / 1e6, 0);
+            }
+            request.done = true;
+        });
+        request.feedback->discarded = lamed([&, find](auto, auto feedback) noexcept {
+            find(feedback).done = true;
+        });
+    };
+
+    // Commits what the render thread has just finished, if it drew into a buffer.
+    auto present = [&] {
+        running = false;
+        job.resized = false;
+        job.cleared = false;
+        job.retabulate.reset();
+        job.poster.reset();
+        auto target = std::exchange(job.target, nullptr);
+        if (target == nullptr) {
+            return;
+        }
+        if (viewport && job.elapsed > 0) {
+            adapt(job.elapsed);
+        }
+        auto const t0 = std::chrono::steady_clock::now();
+        if (measure_latency && job.inputs.empty() == false) {
+            request_feedback(std::exchange(job.inputs, {}));
+        }
+        job.inputs.clear(); // shown now, whether measured or not
+        if (opt.overlay) {
+            if (auto rect = draw_overlay(*target); rect.empty() == false) {
+                job.damage.add(rect);
+            }
+        }
+        frame = wrapper{wl_surface_frame(surface)};
+        frame->done = lamed([&](auto...) noexcept {
+            frame_pending = false;
+        });
+        frame_pending = true;
+        target->busy = true;
+        for (auto [x0, y0, x1, y1] : job.damage) {
+            wl_surface_damage_buffer(surface, x0, y0, x1 - x0, y1 - y0);
+        }
+        job.damage = {};
+        wl_surface_attach(surface, target->buffer, 0, 0);
         wl_surface_commit(surface);
-        wl_display_flush(display);
+        profile.record(stage::commit, host_ms(t0), 0);
+        ++presented;
+        if (log && t0 - reported >= std::chrono::seconds(1)) {
+            reported = t0;
+            profile.write_json(*log, std::chrono::duration<double>(t0 - started).count(), presented);
+        }
+    };
+
+    wl_surface_commit(surface);
+
+    // Wayland events, finished jobs and the catch-up timer are waited on together; the queue is
+    // read with prepare_read/read_events so no event is dispatched behind the loop's back.
+    std::array<pollfd, 3> fds = {{
+        { wl_display_get_fd(display), POLLIN, 0 },
+        { finished, POLLIN, 0 },
+        { timer, POLLIN, 0 },
+    }};
+    // Every way out of the loop breaks, so that the render thread below is still joined.
+    while (quit == false) {
+        bool prepared = true;
+        while (wl_display_prepare_read(display) != 0) {
+            if (wl_display_dispatch_pending(display) == -1) {
+                prepared = false; // the connection is gone, and no read is prepared to cancel
+                break;
+            }
+        }
+        if (prepared == false) {
+            break;
+        }
+        fds[0].events = POLLIN;
+        if (wl_display_flush(display) < 0) {
+            if (errno != EAGAIN) {
+                wl_display_cancel_read(display);
+                break;
+            }
+            fds[0].events |= POLLOUT; // the rest is sent on the next round, once the socket drains
+        }
+        if (::poll(fds.data(), fds.size(), -1) < 0) {
+            wl_display_cancel_read(display);
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (fds[0].revents & (POLLERR | POLLHUP)) {
+            wl_display_cancel_read(display);
+            break;
+        }
+        auto const t0 = std::chrono::steady_clock::now();
+        if (fds[0].revents & POLLIN) {
+            if (wl_display_read_events(display) == -1) {
+                break;
+            }
+        }
+        else {
+            wl_display_cancel_read(display);
+        }
+        if (wl_display_dispatch_pending(display) == -1) {
+            break;
+        }
+        if (fds[0].revents & POLLIN) {
+            profile.record(stage::dispatch, host_ms(t0), 0);
+        }
+        uint64_t count;
+        if ((fds[1].revents & POLLIN) && ::read(finished, &count, sizeof count) > 0) {
+            present();
+        }
+        if ((fds[2].revents & POLLIN) && ::read(timer, &count, sizeof count) > 0) {
+            armed = false;
+            catch_up = true;
+        }
+        schedule();
+    }
+    worker.wait(worker_state::busy, std::memory_order_acquire);
+    worker.store(worker_state::quit, std::memory_order_release);
+    worker.notify_one();
+    renderer.join();
+    if (auto sum = profile.summarize(stage::latency); sum.runs) {
+        std::cout << "input latency p50 " << sum.host_p50 << " ms, p99 " << sum.host_p99 << " ms, last "
+                  << std::min(sum.runs, stage_profile::WINDOW) << " of " << sum.runs << " samples" << std::endl;
     }
     return 0;
 }
+#endif // OTHONES_NO_MAIN